@@ -256,8 +256,28 @@ struct Csite
     /* making the actual marks requires a bunch of other stuff */
     const double *x, *y, *z;    /* mesh coordinates and function values */
     double *xcp, *ycp;          /* output contour points */
+
+    /* pooled output scratch, grown geometrically and reused by
+     * successive traces on this site instead of being allocated and
+     * freed per call */
+    double *xbuf, *ybuf;        /* capacity xybufsize points */
+    long *nsegbuf;              /* capacity nsegbufsize parts */
+    long xybufsize;
+    long nsegbufsize;
 };
 
+/* One-slot pool of the mesh-sized work arrays, keyed by grid size.
+ * Animation exports recontour every frame, recreating a Cntr object
+ * on the same grid each time; handing the arrays of the last deleted
+ * site to the next site of the same size keeps frame-to-frame times
+ * flat instead of churning the heap as the process ages.  Only
+ * touched with the GIL held. */
+static Cdata *pool_data = NULL;
+static short *pool_triangle = NULL;
+static char *pool_reg = NULL;
+static long pool_nreg = 0;
+static long pool_ijmax = 0;
+
 #if 0
 static void print_Csite(Csite *Csite)
 {
@@ -1292,6 +1312,11 @@ cntr_new(void)
     site->x = NULL;
     site->y = NULL;
     site->z = NULL;
+    site->xbuf = NULL;
+    site->ybuf = NULL;
+    site->nsegbuf = NULL;
+    site->xybufsize = 0;
+    site->nsegbufsize = 0;
     return site;
 }
 
@@ -1305,24 +1330,43 @@ cntr_init(Csite *site, long iMax, long jMax, double *x, double *y,
 
     site->imax = iMax;
     site->jmax = jMax;
-    site->data = (Cdata *) PyMem_Malloc(sizeof(Cdata) * nreg);
-    if (site->data == NULL)
+    site->reg = NULL;
+    if (pool_data != NULL && pool_nreg == nreg && pool_ijmax == ijmax)
     {
-        PyMem_Free(site);
-        return -1;
+        /* take over the arrays of the previous same-sized site */
+        site->data = pool_data;
+        site->triangle = pool_triangle;
+        if (mask != NULL)
+            site->reg = pool_reg;
+        else
+            PyMem_Free(pool_reg);
+        pool_data = NULL;
+        pool_triangle = NULL;
+        pool_reg = NULL;
+        pool_nreg = 0;
+        pool_ijmax = 0;
     }
-    site->triangle = (short *) PyMem_Malloc(sizeof(short) * ijmax);
-    if (site->triangle == NULL)
+    else
     {
-        PyMem_Free(site->data);
-        PyMem_Free(site);
-        return -1;
+        site->data = (Cdata *) PyMem_Malloc(sizeof(Cdata) * nreg);
+        if (site->data == NULL)
+        {
+            PyMem_Free(site);
+            return -1;
+        }
+        site->triangle = (short *) PyMem_Malloc(sizeof(short) * ijmax);
+        if (site->triangle == NULL)
+        {
+            PyMem_Free(site->data);
+            PyMem_Free(site);
+            return -1;
+        }
     }
     for (i = 0; i < ijmax; i++) site->triangle[i] = 0;
-    site->reg = NULL;
     if (mask != NULL)
     {
-        site->reg = (char *) PyMem_Malloc(sizeof(char) * nreg);
+        if (site->reg == NULL)
+            site->reg = (char *) PyMem_Malloc(sizeof(char) * nreg);
         if (site->reg == NULL)
         {
             PyMem_Free(site->triangle);
@@ -1343,9 +1387,24 @@ cntr_init(Csite *site, long iMax, long jMax, double *x, double *y,
 
 static void cntr_del(Csite *site)
 {
-    PyMem_Free(site->triangle);
-    PyMem_Free(site->reg);
-    PyMem_Free(site->data);
+    if (pool_data == NULL && site->data != NULL)
+    {
+        /* park the arrays for the next site on this grid size */
+        pool_data = site->data;
+        pool_triangle = site->triangle;
+        pool_reg = site->reg;
+        pool_nreg = site->imax * site->jmax + site->imax + 1;
+        pool_ijmax = site->imax * site->jmax;
+    }
+    else
+    {
+        PyMem_Free(site->triangle);
+        PyMem_Free(site->reg);
+        PyMem_Free(site->data);
+    }
+    PyMem_Free(site->xbuf);
+    PyMem_Free(site->ybuf);
+    PyMem_Free(site->nsegbuf);
     PyMem_Free(site);
     site = NULL;
 }
@@ -1473,6 +1532,7 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
     double *yp0;
     long *nseg0;
     int iseg;
+    int traceerr;
 
     /* long nchunk = 30; was hardwired */
     long n;
@@ -1488,6 +1548,12 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
         site->zlevel[1] = levels[1];
     }
     site->n = site->count = 0;
+
+    /* the marking and tracing passes below are pure C working on the
+       site arrays, so drop the GIL; each Cntr object owns its site,
+       letting Python threads trace different levels of separate
+       Cntr instances concurrently */
+    Py_BEGIN_ALLOW_THREADS
     data_init (site, 0, nchunk);
 
     /* make first pass to compute required sizes for second pass */
@@ -1507,10 +1573,35 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
             ntotal -= n;
         }
     }
-    xp0 = (double *) PyMem_Malloc(ntotal * sizeof(double));
-    yp0 = (double *) PyMem_Malloc(ntotal * sizeof(double));
-    nseg0 = (long *) PyMem_Malloc(nparts * sizeof(long));
-    if (xp0 == NULL || yp0 == NULL || nseg0 == NULL)
+    Py_END_ALLOW_THREADS
+
+    /* grow the pooled output scratch geometrically; it stays with the
+       site for later traces (e.g. the other levels of this contour
+       set) instead of being freed on return */
+    if (ntotal > site->xybufsize)
+    {
+        long newsize = site->xybufsize > 0 ? site->xybufsize : 1024;
+        while (newsize < ntotal) newsize *= 2;
+        PyMem_Free(site->xbuf);
+        PyMem_Free(site->ybuf);
+        site->xbuf = (double *) PyMem_Malloc(newsize * sizeof(double));
+        site->ybuf = (double *) PyMem_Malloc(newsize * sizeof(double));
+        site->xybufsize = (site->xbuf != NULL && site->ybuf != NULL) ?
+            newsize : 0;
+    }
+    if (nparts > site->nsegbufsize)
+    {
+        long newsize = site->nsegbufsize > 0 ? site->nsegbufsize : 64;
+        while (newsize < nparts) newsize *= 2;
+        PyMem_Free(site->nsegbuf);
+        site->nsegbuf = (long *) PyMem_Malloc(newsize * sizeof(long));
+        site->nsegbufsize = site->nsegbuf != NULL ? newsize : 0;
+    }
+    xp0 = site->xbuf;
+    yp0 = site->ybuf;
+    nseg0 = site->nsegbuf;
+    if ((ntotal > 0 && (xp0 == NULL || yp0 == NULL)) ||
+        (nparts > 0 && nseg0 == NULL))
     {
 	PyErr_NoMemory();
 	goto error;
@@ -1520,14 +1611,15 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
     site->xcp = xp0;
     site->ycp = yp0;
     iseg = 0;
+    traceerr = 0;
+    Py_BEGIN_ALLOW_THREADS
     for (;;iseg++)
     {
         n = curve_tracer (site, 1);
         if (ntotal2 + n > ntotal)
         {
-            PyErr_SetString(PyExc_RuntimeError,
-                "curve_tracer: ntotal2, pass 2 exceeds ntotal, pass 1");
-            goto error;
+            traceerr = 1;
+            break;
         }
         if (n == 0)
             break;
@@ -1542,11 +1634,24 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
         }
         else
         {
-            PyErr_SetString(PyExc_RuntimeError,
-                "Negative n from curve_tracer in pass 2");
-            goto error;
+            traceerr = 2;
+            break;
         }
     }
+    Py_END_ALLOW_THREADS
+
+    if (traceerr == 1)
+    {
+        PyErr_SetString(PyExc_RuntimeError,
+            "curve_tracer: ntotal2, pass 2 exceeds ntotal, pass 1");
+        goto error;
+    }
+    if (traceerr == 2)
+    {
+        PyErr_SetString(PyExc_RuntimeError,
+            "Negative n from curve_tracer in pass 2");
+        goto error;
+    }
 
 
     if (points)
@@ -1557,12 +1662,10 @@ cntr_trace(Csite *site, double levels[], int nlevels, int points, long nchunk)
     {
         c_list = build_cntr_list_v2(nseg0, xp0, yp0, nparts, ntotal);
     }
-    PyMem_Free(xp0); PyMem_Free(yp0); PyMem_Free(nseg0);
     site->xcp = NULL; site->ycp = NULL;
     return c_list;
 
     error:
-    PyMem_Free(xp0); PyMem_Free(yp0); PyMem_Free(nseg0);
     site->xcp = NULL; site->ycp = NULL;
     return NULL;
 }
@@ -1747,7 +1850,10 @@ static PyMethodDef Cntr_methods[] = {
      "    Optional argument: points; if 0 (default), return a list of\n"
      "        vector pairs; otherwise, return a list of lists of points.\n"
      "    Optional argument: nchunk; approximate number of grid points\n"
-     "        per chunk. 0 (default) for no chunking.\n"
+     "        per chunk. 0 (default) for no chunking.\n\n"
+     "    The GIL is released while tracing, so separate Cntr\n"
+     "    instances can trace different levels concurrently from\n"
+     "    Python threads.\n"
     },
     {NULL}  /* Sentinel */
 };
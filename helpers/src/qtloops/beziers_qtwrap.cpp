@@ -18,6 +18,13 @@
 
 #include "beziers.h"
 #include "beziers_qtwrap.h"
+#include "isnan.h"
+
+#include <cmath>
+
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 
 QPolygonF bezier_fit_cubic_single( const QPolygonF& data, double error )
 {
@@ -49,3 +56,125 @@ QPolygonF bezier_fit_cubic_multi( const QPolygonF& data, double error,
     return QPolygonF();
 }
 
+
+namespace
+{
+  // unit tangent from one point towards another, or a zero
+  // (unconstrained) tangent if the points coincide
+  QPointF seamTangent(const QPointF& from, const QPointF& to)
+  {
+    const double dx = to.x()-from.x();
+    const double dy = to.y()-from.y();
+    const double len = std::sqrt(dx*dx+dy*dy);
+    if( ! isFinite(len) || len == 0. )
+      return QPointF(0, 0);
+    return QPointF(dx/len, dy/len);
+  }
+
+  // fit one chunk of a polyline, with tangents constrained at chunk
+  // seams so neighbouring fits join smoothly
+  class BezierChunkTask : public QRunnable
+  {
+  public:
+    BezierChunkTask(const QPointF* data, int len,
+		    const QPointF& that1, const QPointF& that2,
+		    double error)
+      : _data(data), _len(len), _that1(that1), _that2(that2),
+	_error(error), _numsegs(0)
+    {
+      setAutoDelete(false);
+      // never needs more segments than gaps between points
+      _out.resize((len-1)*4);
+    }
+
+    void run()
+    {
+      _numsegs = sp_bezier_fit_cubic_full(_out.data(), NULL,
+					  _data, _len,
+					  _that1, _that2,
+					  _error, unsigned(_len-1));
+    }
+
+    // fitted control points, 4 per segment
+    const QPointF* points() const { return _out.constData(); }
+    int numsegs() const { return _numsegs > 0 ? _numsegs : 0; }
+
+  private:
+    const QPointF* _data;
+    int _len;
+    QPointF _that1, _that2;
+    double _error;
+    int _numsegs;
+    QPolygonF _out;
+  };
+}
+
+QPolygonF bezier_fit_cubic_chunked( const QPolygonF& data, double error,
+				    int chunksize )
+{
+  if( chunksize < 4 )
+    chunksize = 4;
+
+  // drop nans and adjacent duplicates once for the whole polyline
+  // (precondition of sp_bezier_fit_cubic_full, which the chunks call
+  // directly)
+  QPolygonF cleaned;
+  cleaned.reserve(data.size());
+  for(int i = 0; i < data.size(); ++i)
+    {
+      const QPointF pt = data[i];
+      if( ! isFinite(pt.x()) || ! isFinite(pt.y()) )
+	continue;
+      if( cleaned.isEmpty() || pt != cleaned.last() )
+	cleaned << pt;
+    }
+
+  const int n = cleaned.size();
+  if( n < 2 )
+    return QPolygonF();
+
+  // split into chunks sharing a boundary point, with the tangent at
+  // each seam taken from the points either side of it, so both
+  // neighbouring fits are constrained to the same tangent line
+  QVector<BezierChunkTask*> tasks;
+  int start = 0;
+  while( start < n-1 )
+    {
+      const int end = qMin(start+chunksize, n-1);
+
+      const QPointF that1 = (start == 0) ? QPointF(0, 0) :
+	seamTangent(cleaned[start-1], cleaned[start+1]);
+      const QPointF that2 = (end == n-1) ? QPointF(0, 0) :
+	seamTangent(cleaned[end+1], cleaned[end-1]);
+
+      tasks.append( new BezierChunkTask(cleaned.constData()+start,
+					end-start+1,
+					that1, that2, error) );
+      start = end;
+    }
+
+  // independent chunks can fit in parallel
+  if( tasks.size() > 1 && QThread::idealThreadCount() > 1 )
+    {
+      QThreadPool pool;
+      for(int i = 0; i < tasks.size(); ++i)
+	pool.start(tasks[i]);
+      pool.waitForDone();
+    }
+  else
+    {
+      for(int i = 0; i < tasks.size(); ++i)
+	tasks[i]->run();
+    }
+
+  // stitch the fitted segments together in order
+  QPolygonF out;
+  for(int i = 0; i < tasks.size(); ++i)
+    {
+      const int numpts = tasks[i]->numsegs()*4;
+      for(int p = 0; p < numpts; ++p)
+	out << tasks[i]->points()[p];
+      delete tasks[i];
+    }
+  return out;
+}
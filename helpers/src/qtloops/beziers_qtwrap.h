@@ -27,4 +27,11 @@ QPolygonF bezier_fit_cubic_single(const QPolygonF& data, double error);
 QPolygonF bezier_fit_cubic_multi(const QPolygonF& data, double error,
 				 unsigned max_beziers);
 
+// fit long polylines by splitting them into chunks of around
+// chunksize points, fitted independently (in parallel for large
+// inputs) with shared tangent constraints at the seams, avoiding the
+// deep recursion and repeated reparameterization of whole-curve fits
+QPolygonF bezier_fit_cubic_chunked(const QPolygonF& data, double error,
+				   int chunksize = 1000);
+
 #endif
@@ -0,0 +1,156 @@
+//    Copyright (C) 2012 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "instrument.h"
+
+#include <cstring>
+
+#include <QList>
+#include <QMutex>
+#include <QThreadStorage>
+
+bool instrumentenabled = false;
+
+// each thread owns a counter block, registered globally so snapshots
+// can sum over live threads; when a thread exits its counts are
+// folded into the retired totals
+struct InstrumentThreadData
+{
+  InstrumentCounters c[InstrNumFuncs];
+  // nesting depth per function in this thread
+  int depth[InstrNumFuncs];
+
+  InstrumentThreadData();
+  ~InstrumentThreadData();
+};
+
+namespace
+{
+  QMutex reglock;
+  QList<InstrumentThreadData*> registry;
+  InstrumentCounters retired[InstrNumFuncs];
+
+  QThreadStorage<InstrumentThreadData*> threadstorage;
+
+  // counter block of the calling thread, created on first use
+  InstrumentThreadData* threadData()
+  {
+    if( ! threadstorage.hasLocalData() )
+      threadstorage.setLocalData( new InstrumentThreadData );
+    return threadstorage.localData();
+  }
+
+  void addCounters(InstrumentCounters& to, const InstrumentCounters& from)
+  {
+    to.calls += from.calls;
+    to.pointsin += from.pointsin;
+    to.pointsout += from.pointsout;
+    to.drawcalls += from.drawcalls;
+    to.ns += from.ns;
+  }
+}
+
+InstrumentThreadData::InstrumentThreadData()
+{
+  std::memset(c, 0, sizeof(c));
+  std::memset(depth, 0, sizeof(depth));
+  QMutexLocker locker(&reglock);
+  registry.append(this);
+}
+
+InstrumentThreadData::~InstrumentThreadData()
+{
+  QMutexLocker locker(&reglock);
+  for(int f = 0; f < InstrNumFuncs; ++f)
+    addCounters(retired[f], c[f]);
+  registry.removeAll(this);
+}
+
+void setInstrumentEnabled(bool on)
+{
+  instrumentenabled = on;
+}
+
+const char* instrumentName(int func)
+{
+  switch(func)
+    {
+    case InstrPlotPaths: return "plotPathsToPainter";
+    case InstrPlotLines: return "plotLinesToPainter";
+    case InstrPlotBoxes: return "plotBoxesToPainter";
+    case InstrClippedPolyline: return "plotClippedPolyline";
+    case InstrNumpyToQImage: return "numpyToQImage";
+    case InstrBinData: return "binData";
+    default: return "";
+    }
+}
+
+// counters updated by other threads while the lock is held are plain
+// integers, so a snapshot taken mid-draw may miss an in-flight call;
+// totals are exact once the instrumented calls have returned
+void instrumentSnapshot(InstrumentCounters* out)
+{
+  QMutexLocker locker(&reglock);
+  for(int f = 0; f < InstrNumFuncs; ++f)
+    {
+      out[f] = retired[f];
+      for(int t = 0; t < registry.size(); ++t)
+	addCounters(out[f], registry[t]->c[f]);
+    }
+}
+
+void instrumentReset()
+{
+  QMutexLocker locker(&reglock);
+  std::memset(retired, 0, sizeof(retired));
+  for(int t = 0; t < registry.size(); ++t)
+    std::memset(registry[t]->c, 0, sizeof(registry[t]->c));
+}
+
+InstrumentScope::InstrumentScope(InstrumentFunc func)
+  : _data(0), _func(func),
+    _pointsin(0), _pointsout(0), _drawcalls(0)
+{
+  if( ! instrumentenabled )
+    return;
+
+  _data = threadData();
+  ++_data->depth[func];
+  _timer.start();
+}
+
+InstrumentScope::~InstrumentScope()
+{
+  if( _data == 0 )
+    return;
+
+  // accumulate from the outermost scope only
+  if( --_data->depth[_func] == 0 )
+    {
+      InstrumentCounters& c = _data->c[_func];
+      c.calls += 1;
+      c.pointsin += _pointsin;
+      c.pointsout += _pointsout;
+      c.drawcalls += _drawcalls;
+#if QT_VERSION >= 0x040800
+      c.ns += _timer.nsecsElapsed();
+#else
+      c.ns += qint64(_timer.elapsed()) * 1000000;
+#endif
+    }
+}
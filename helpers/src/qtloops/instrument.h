@@ -0,0 +1,94 @@
+// -*- mode: C++; -*-
+
+//    Copyright (C) 2012 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+
+// lightweight instrumentation of the plotting hot paths, so slowness
+// can be diagnosed from a running program without rebuilding with a
+// profiler: each instrumented function accumulates call counts,
+// point counts and wall clock time into per-thread slots, which
+// python can snapshot and reset through the module
+
+// slot for each instrumented function
+enum InstrumentFunc
+{
+  InstrPlotPaths,
+  InstrPlotLines,
+  InstrPlotBoxes,
+  InstrClippedPolyline,
+  InstrNumpyToQImage,
+  InstrBinData,
+  InstrNumFuncs
+};
+
+// counters kept for each slot
+struct InstrumentCounters
+{
+  qint64 calls;      // calls made
+  qint64 pointsin;   // points passed in
+  qint64 pointsout;  // points surviving clipping or decimation
+  qint64 drawcalls;  // painter draw calls issued
+  qint64 ns;         // wall clock nanoseconds spent
+};
+
+// master switch; off by default so the only cost in the hot paths is
+// a single predictable branch per call
+extern bool instrumentenabled;
+
+void setInstrumentEnabled(bool on);
+
+// name of a slot, used as the key in the python snapshot
+const char* instrumentName(int func);
+
+// sum the per-thread counters into out[InstrNumFuncs]
+void instrumentSnapshot(InstrumentCounters* out);
+
+// zero all counters
+void instrumentReset();
+
+// defined in instrument.cpp
+struct InstrumentThreadData;
+
+// scope placed at the top of an instrumented function: times the
+// call and folds the counts into the calling thread's slot on
+// destruction; only the outermost scope per function accumulates, so
+// functions calling themselves are counted once
+class InstrumentScope
+{
+public:
+  InstrumentScope(InstrumentFunc func);
+  ~InstrumentScope();
+
+  void addPointsIn(qint64 n) { _pointsin += n; }
+  void addPointsOut(qint64 n) { _pointsout += n; }
+  void addDrawCall() { ++_drawcalls; }
+
+private:
+  InstrumentThreadData* _data;
+  InstrumentFunc _func;
+  qint64 _pointsin, _pointsout, _drawcalls;
+  QElapsedTimer _timer;
+};
+
+#endif
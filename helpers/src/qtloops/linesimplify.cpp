@@ -0,0 +1,141 @@
+// Copyright (C) 2012 Jeremy Sanders
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+// 02110-1301, USA.
+////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <QPair>
+#include <QVector>
+
+#include "linesimplify.h"
+#include "isnan.h"
+
+using std::fabs;
+using std::sqrt;
+
+namespace
+{
+  // perpendicular distance of pt from the line through pt1 and pt2
+  // falls back to point distance if pt1 and pt2 coincide
+  inline double segmentDistance(const QPointF& pt,
+				const QPointF& pt1, const QPointF& pt2)
+  {
+    const double dx = pt2.x() - pt1.x();
+    const double dy = pt2.y() - pt1.y();
+    const double len = sqrt(dx*dx + dy*dy);
+    if( len == 0. )
+      {
+	const double ddx = pt.x() - pt1.x();
+	const double ddy = pt.y() - pt1.y();
+	return sqrt(ddx*ddx + ddy*ddy);
+      }
+    return fabs( dx*(pt1.y()-pt.y()) - dy*(pt1.x()-pt.x()) ) / len;
+  }
+
+  // apply Douglas-Peucker to the finite points first..last
+  // (inclusive), appending kept points to out
+  void simplifySection(const QPolygonF& poly, int first, int last,
+		       double epsilon, QPolygonF& out)
+  {
+    if( last - first < 2 )
+      {
+	// too few points to drop any
+	for(int i = first; i <= last; ++i)
+	  out << poly[i];
+	return;
+      }
+
+    // flags for points to keep in output
+    QVector<bool> keep(last-first+1, false);
+    keep[0] = keep[last-first] = true;
+
+    // explicit stack of ranges to examine, avoiding deep recursion on
+    // large polylines
+    QVector< QPair<int,int> > stack;
+    stack.push_back( QPair<int,int>(first, last) );
+
+    while( ! stack.isEmpty() )
+      {
+	const QPair<int,int> range = stack.last();
+	stack.pop_back();
+	const int lo = range.first;
+	const int hi = range.second;
+
+	// find point furthest from the line joining the range ends
+	double maxdist = 0.;
+	int maxidx = lo;
+	for(int i = lo+1; i < hi; ++i)
+	  {
+	    const double dist = segmentDistance(poly[i], poly[lo], poly[hi]);
+	    if( dist > maxdist )
+	      {
+		maxdist = dist;
+		maxidx = i;
+	      }
+	  }
+
+	if( maxdist > epsilon )
+	  {
+	    // keep the furthest point and examine the halves either side
+	    keep[maxidx-first] = true;
+	    if( maxidx - lo > 1 )
+	      stack.push_back( QPair<int,int>(lo, maxidx) );
+	    if( hi - maxidx > 1 )
+	      stack.push_back( QPair<int,int>(maxidx, hi) );
+	  }
+      }
+
+    for(int i = first; i <= last; ++i)
+      {
+	if( keep[i-first] )
+	  out << poly[i];
+      }
+  }
+}
+
+QPolygonF simplifyPolyline(const QPolygonF& poly, double epsilon)
+{
+  const int size = poly.size();
+  if( size < 3 )
+    return poly;
+
+  QPolygonF out;
+
+  // non-finite points mark breaks in the line, so simplify each
+  // finite section separately and copy the breaks through; distances
+  // involving nan points compare false, which would otherwise drop
+  // them and join the sections up
+  int i = 0;
+  while( i < size )
+    {
+      if( ! isFinite(poly[i].x()) || ! isFinite(poly[i].y()) )
+	{
+	  out << poly[i];
+	  ++i;
+	  continue;
+	}
+
+      // find extent of this finite section
+      int j = i;
+      while( j < size && isFinite(poly[j].x()) && isFinite(poly[j].y()) )
+	++j;
+
+      simplifySection(poly, i, j-1, epsilon, out);
+      i = j;
+    }
+
+  return out;
+}
@@ -0,0 +1,32 @@
+// -*- mode: C++; -*-
+
+// Copyright (C) 2012 Jeremy Sanders
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+// 02110-1301, USA.
+////////////////////////////////////////////////////////////////////
+
+#ifndef LINESIMPLIFY_HH
+#define LINESIMPLIFY_HH
+
+#include <QPolygonF>
+
+// simplify a polyline with the Douglas-Peucker algorithm, dropping
+// points less than epsilon away from the simplified line
+// endpoints are always kept; non-finite points break the line and
+// are passed through unchanged
+QPolygonF simplifyPolyline(const QPolygonF& poly, double epsilon);
+
+#endif
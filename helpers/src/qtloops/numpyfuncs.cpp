@@ -18,19 +18,170 @@
 
 #include "numpyfuncs.h"
 #include <limits>
+#include <math.h>
 #include "isnan.h"
+#include "instrument.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace {
   template <class T> inline T min(T a, T b)
   {
     return (a<b) ? a : b;
   }
+  template <class T> inline T max(T a, T b)
+  {
+    return (a>b) ? a : b;
+  }
+
+  // bin a single column of data (shared by binData and binDataMulti)
+  void binColumn(const double* data, int stride, int dim,
+		 int binning, bool average, double* out)
+  {
+    double sum = 0.;
+    int ct = 0;
+    for(int i = 0 ; i < dim; ++i)
+      {
+	const double v = data[i*stride];
+
+	// include new data
+	if ( isFinite(v) )
+	  {
+	    sum += v;
+	    ct += 1;
+	  }
+
+	// every bin or at end of array
+	if ( i % binning == binning-1 || i == dim-1 )
+	  {
+	    if( ct == 0 )
+	      {
+		out[i / binning] = std::numeric_limits<double>::quiet_NaN();
+	      }
+	    else
+	      {
+		if( average )
+		  out[i / binning] = sum / ct;
+		else
+		  out[i / binning] = sum;
+	      }
+	    sum = 0;
+	    ct = 0;
+	  }
+      }
+  }
+
+  // bin a range of columns (used to spread wide tables over threads)
+  class BinColumnsTask : public QRunnable
+  {
+  public:
+    BinColumnsTask(const Tuple2Ptrs& d, int binning, bool average,
+		   QVector<double*>& outdata, int colstart, int colend)
+      : _d(d), _binning(binning), _average(average),
+	_outdata(outdata), _colstart(colstart), _colend(colend)
+    {
+      setAutoDelete(false);
+    }
+
+    void run()
+    {
+      for(int col = _colstart; col < _colend; ++col)
+	binColumn(_d.data[col], 1, _d.dims[col],
+		  _binning, _average, _outdata[col]);
+    }
+
+  private:
+    const Tuple2Ptrs& _d;
+    int _binning;
+    bool _average;
+    QVector<double*>& _outdata;
+    int _colstart, _colend;
+  };
+
+  // minimum total elements before threading binDataMulti pays off
+  const int BINMINELEMENTS = 65536;
+
+  // accumulate a range of points into a private grid, merged by the
+  // caller once every task has finished
+  class Histogram2DTask : public QRunnable
+  {
+  public:
+    Histogram2DTask(const Numpy1DObj& x, const Numpy1DObj& y,
+		    const Numpy1DObj* weights,
+		    double xmin, double xmax, double ymin, double ymax,
+		    double xinv, double yinv,
+		    int xbins, int ybins,
+		    int start, int end)
+      : _x(x), _y(y), _weights(weights),
+	_xmin(xmin), _xmax(xmax), _ymin(ymin), _ymax(ymax),
+	_xinv(xinv), _yinv(yinv),
+	_xbins(xbins), _ybins(ybins),
+	_start(start), _end(end),
+	_grid(new double[xbins*ybins])
+    {
+      setAutoDelete(false);
+      for(int i = 0; i < _xbins*_ybins; ++i)
+	_grid[i] = 0.;
+    }
+
+    ~Histogram2DTask()
+    {
+      delete[] _grid;
+    }
+
+    void run()
+    {
+      for(int i = _start; i < _end; ++i)
+	{
+	  // nan coordinates fail these comparisons and are dropped,
+	  // as are points outside the ranges; points exactly on the
+	  // upper edges land in the last bin
+	  const double xv = _x(i);
+	  const double yv = _y(i);
+	  if( ! (xv >= _xmin && xv <= _xmax) ||
+	      ! (yv >= _ymin && yv <= _ymax) )
+	    continue;
+	  const int ix = min( int((xv-_xmin)*_xinv), _xbins-1 );
+	  const int iy = min( int((yv-_ymin)*_yinv), _ybins-1 );
+
+	  double w = 1.;
+	  if( _weights != 0 )
+	    {
+	      w = (*_weights)(i);
+	      if( ! isFinite(w) )
+		continue;
+	    }
+	  _grid[iy*_xbins+ix] += w;
+	}
+    }
+
+    const double* grid() const { return _grid; }
+
+  private:
+    const Numpy1DObj& _x;
+    const Numpy1DObj& _y;
+    const Numpy1DObj* _weights;
+    double _xmin, _xmax, _ymin, _ymax;
+    double _xinv, _yinv;
+    int _xbins, _ybins;
+    int _start, _end;
+    double* _grid;
+  };
 }
 
 void binData(const Numpy1DObj& indata, int binning,
 	     bool average,
 	     int* numoutbins, double** outdata)
 {
+  InstrumentScope instr(InstrBinData);
+  instr.addPointsIn(indata.dim);
+
   // round up output size
   int size = indata.dim / binning;
   if( indata.dim % binning != 0 )
@@ -41,36 +192,56 @@ void binData(const Numpy1DObj& indata, int binning,
   double *out = new double[size];
   *outdata = out;
 
-  // do binning
-  double sum = 0.;
-  int ct = 0;
-  for(int i = 0 ; i < indata.dim; ++i)
+  binColumn(indata.data, indata.stride, indata.dim, binning, average, out);
+}
+
+void binDataMulti(const Tuple2Ptrs& d, int binning,
+		  bool average,
+		  QVector<int>& numoutbins, QVector<double*>& outdata)
+{
+  const int numcols = d.data.size();
+
+  // allocate an output array per column, rounding sizes up
+  numoutbins.resize(numcols);
+  outdata.resize(numcols);
+  int totelements = 0;
+  for(int col = 0; col < numcols; ++col)
     {
-      // include new data
-      if ( isFinite( indata(i) ) )
-	{
-	  sum += indata(i);
-	  ct += 1;
-	}
+      int size = d.dims[col] / binning;
+      if( d.dims[col] % binning != 0 )
+	++size;
+      numoutbins[col] = size;
+      outdata[col] = new double[size];
+      totelements += d.dims[col];
+    }
 
-      // every bin or at end of array
-      if ( i % binning == binning-1 || i == indata.dim-1 )
-	{
-	  if( ct == 0 )
-	    {
-	      out[i / binning] = std::numeric_limits<double>::quiet_NaN();
-	    }
-	  else
-	    {
-	      if( average )
-		out[i / binning] = sum / ct;
-	      else
-		out[i / binning] = sum;
-	    }
-	  sum = 0;
-	  ct = 0;
-	}
+  const int numthreads = QThread::idealThreadCount();
+  if( numthreads < 2 || numcols < 2 || totelements < BINMINELEMENTS )
+    {
+      // not worth starting threads
+      for(int col = 0; col < numcols; ++col)
+	binColumn(d.data[col], 1, d.dims[col], binning, average,
+		  outdata[col]);
+      return;
     }
+
+  // hand each thread a contiguous block of columns
+  const int numtasks = min(numthreads, numcols);
+  const int colspertask = numcols / numtasks + (numcols % numtasks != 0);
+
+  QThreadPool pool;
+  QVector<BinColumnsTask*> tasks;
+  for(int colstart = 0; colstart < numcols; colstart += colspertask)
+    {
+      BinColumnsTask* task =
+	new BinColumnsTask(d, binning, average, outdata,
+			   colstart, min(colstart+colspertask, numcols));
+      tasks.append(task);
+      pool.start(task);
+    }
+  pool.waitForDone();
+  for(int i = 0; i < tasks.size(); ++i)
+    delete tasks[i];
 }
 
 void rollingAverage(const Numpy1DObj& indata,
@@ -88,39 +259,167 @@ void rollingAverage(const Numpy1DObj& indata,
   double *out = new double[size];
   *outdata = out;
 
+  // cumulative sums of weighted values and weights, so each window
+  // below is two lookups rather than a loop over its width
+  // cumval[i] and cumwt[i] hold sums over elements [0,i)
+  // non-finite values or weights contribute zero weight
+  double* cumval = new double[size+1];
+  double* cumwt = new double[size+1];
+  cumval[0] = cumwt[0] = 0.;
   for(int i = 0 ; i < size; ++i)
     {
-      double ct = 0.;
-      double sum = 0.;
-
-      // iterate over rolling width
-      for(int di = -width; di <= width; ++di)
+      const double v = indata(i);
+      double w = 0.;
+      if( isFinite(v) )
 	{
-	  const int ri = di+i;
-	  if ( ri >= 0 && ri < size && isFinite(indata(ri)) )
+	  if( weights != 0 )
 	    {
-	      if( weights != 0 )
-		{
-		  // weighted average
-		  const double w = (*weights)(ri);
-		  if( isFinite(w) )
-		    {
-		      ct += w;
-		      sum += w*indata(ri);
-		    }
-		}
-	      else
-		{
-		  // standard average
-		  ct += 1;
-		  sum += indata(ri);
-		}
+	      // weighted average
+	      const double wv = (*weights)(i);
+	      if( isFinite(wv) )
+		w = wv;
 	    }
+	  else
+	    // standard average
+	    w = 1.;
 	}
+      // avoid 0*nan poisoning the cumulative sum
+      cumval[i+1] = cumval[i] + (w != 0. ? w*v : 0.);
+      cumwt[i+1] = cumwt[i] + w;
+    }
+
+  for(int i = 0 ; i < size; ++i)
+    {
+      // rolling window, clipped to the ends of the array
+      const int lo = max(i-width, 0);
+      const int hi = min(i+width, size-1);
+      const double ct = cumwt[hi+1] - cumwt[lo];
+      const double sum = cumval[hi+1] - cumval[lo];
 
       if( ct != 0. )
 	out[i] = sum / ct;
       else
 	out[i] = std::numeric_limits<double>::quiet_NaN();
     }
+
+  delete[] cumval;
+  delete[] cumwt;
+}
+
+void histogram2D(const Numpy1DObj& x, const Numpy1DObj& y,
+		 const Numpy1DObj* weights,
+		 double xmin, double xmax, int xbins,
+		 double ymin, double ymax, int ybins,
+		 double** outdata)
+{
+  if( xbins < 1 || ybins < 1 )
+    throw "Numbers of bins must be positive";
+  if( !( xmax > xmin ) || !( ymax > ymin ) )
+    throw "Invalid histogram ranges";
+
+  // the bin counts come from the user, so the product must be checked
+  // in a wide type before it is used as an allocation size: the int
+  // product can overflow, and each thread allocates a grid this big
+  const qint64 numbins64 = qint64(xbins) * qint64(ybins);
+  if( numbins64 > 64*1024*1024 )
+    throw "Too many histogram bins";
+  const int numbins = int(numbins64);
+
+  int size = min(x.dim, y.dim);
+  if( weights != 0 )
+    size = min(size, weights->dim);
+
+  const double xinv = xbins / (xmax-xmin);
+  const double yinv = ybins / (ymax-ymin);
+
+  const int numthreads = QThread::idealThreadCount();
+  const int numtasks =
+    ( numthreads < 2 || size < BINMINELEMENTS ) ? 1 :
+    min(numthreads, size);
+
+  // each task accumulates its range of points into a private grid,
+  // so no locking is needed while binning
+  const int perTask = size / numtasks + (size % numtasks != 0);
+  QThreadPool pool;
+  QVector<Histogram2DTask*> tasks;
+  for(int start = 0; start < size; start += perTask)
+    {
+      Histogram2DTask* task =
+	new Histogram2DTask(x, y, weights, xmin, xmax, ymin, ymax,
+			    xinv, yinv, xbins, ybins,
+			    start, min(start+perTask, size));
+      tasks.append(task);
+      if( numtasks > 1 )
+	pool.start(task);
+      else
+	task->run();
+    }
+  if( numtasks > 1 )
+    pool.waitForDone();
+
+  // merge the private grids into the output
+  double* out = new double[numbins];
+  *outdata = out;
+  for(int i = 0; i < numbins; ++i)
+    out[i] = 0.;
+  for(int t = 0; t < tasks.size(); ++t)
+    {
+      const double* grid = tasks[t]->grid();
+      for(int i = 0; i < numbins; ++i)
+	out[i] += grid[i];
+      delete tasks[t];
+    }
+}
+
+void transformLinear(const Numpy1DObj& indata,
+		     double scale, double offset,
+		     int* numout, double** outdata)
+{
+  const int size = indata.dim;
+  *numout = size;
+  double *out = new double[size];
+  *outdata = out;
+
+  int i = 0;
+
+#ifdef __SSE2__
+  // process pairs of doubles with SSE2 (contiguous input only)
+  // nan inputs propagate through multiply and add unchanged
+  if( indata.stride == 1 )
+    {
+      const __m128d vscale = _mm_set1_pd(scale);
+      const __m128d voffset = _mm_set1_pd(offset);
+      for( ; i+1 < size; i += 2 )
+	{
+	  const __m128d v = _mm_loadu_pd( indata.data + i );
+	  _mm_storeu_pd( out + i,
+			 _mm_add_pd( _mm_mul_pd(v, vscale), voffset ) );
+	}
+    }
+#endif
+
+  // remaining values (or everything without SSE2)
+  for( ; i < size; ++i )
+    out[i] = indata(i)*scale + offset;
+}
+
+void transformLog10(const Numpy1DObj& indata,
+		    double scale, double offset,
+		    int* numout, double** outdata)
+{
+  const int size = indata.dim;
+  *numout = size;
+  double *out = new double[size];
+  *outdata = out;
+
+  // no portable vector log10, so keep a simple loop the compiler
+  // can pipeline
+  for(int i = 0; i < size; ++i)
+    {
+      const double v = indata(i);
+      if( isFinite(v) && v > 0. )
+	out[i] = log10(v)*scale + offset;
+      else
+	out[i] = std::numeric_limits<double>::quiet_NaN();
+    }
 }
@@ -21,12 +21,22 @@
 
 #include "qtloops_helpers.h"
 
+#include <QVector>
+
 // bin up data given by factor. If average is True, then divide by number
 // of elements in bins
 void binData(const Numpy1DObj& indata, int binning,
 	     bool average,
 	     int* numoutbins, double** outdata);
 
+// bin every column in d with shared binning parameters, crossing the
+// Python boundary once for a whole table; columns are spread across
+// threads when there is enough data to make that worthwhile
+// output arrays are allocated with new[] and owned by the caller
+void binDataMulti(const Tuple2Ptrs& d, int binning,
+		  bool average,
+		  QVector<int>& numoutbins, QVector<double*>& outdata);
+
 
 // rolling average calculation
 // weights is an optional weighting array
@@ -35,4 +45,28 @@ void rollingAverage(const Numpy1DObj& indata,
 		    int width,
 		    int* numoutbins, double** outdata);
 
+// apply linear axis transformation out = indata*scale + offset
+// non-finite input values are passed through unchanged
+void transformLinear(const Numpy1DObj& indata,
+		     double scale, double offset,
+		     int* numout, double** outdata);
+
+// apply log axis transformation out = log10(indata)*scale + offset
+// non-finite or non-positive input values give nan
+void transformLog10(const Numpy1DObj& indata,
+		    double scale, double offset,
+		    int* numout, double** outdata);
+
+// histogram points into a 2D grid of xbins*ybins uniform bins
+// covering [xmin,xmax] by [ymin,ymax]
+// if weights is 0 the grid counts points, otherwise it sums weights
+// points outside the ranges or with non-finite coordinates are dropped
+// output is row-major with shape (ybins, xbins), allocated with new[]
+// throws const char* for invalid bin parameters
+void histogram2D(const Numpy1DObj& x, const Numpy1DObj& y,
+		 const Numpy1DObj* weights,
+		 double xmin, double xmax, int xbins,
+		 double ymin, double ymax, int ybins,
+		 double** outdata);
+
 #endif
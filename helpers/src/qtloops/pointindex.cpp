@@ -0,0 +1,133 @@
+//    Copyright (C) 2012 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "pointindex.h"
+#include "isnan.h"
+
+#include <QtAlgorithms>
+#include <cmath>
+
+namespace
+{
+  template<class T> inline T min(T a, T b)
+  {
+    return (a<b) ? a : b;
+  }
+
+  template<class T> inline T max(T a, T b)
+  {
+    return (a>b) ? a : b;
+  }
+
+  template<class T> inline T clipval(T val, T minv, T maxv)
+  {
+    if( val < minv ) return minv;
+    if( val > maxv ) return maxv;
+    return val;
+  }
+
+  // largest grid used along each axis
+  const int MAXGRIDDIM = 1024;
+}
+
+PointIndex::PointIndex(const Numpy1DObj& x, const Numpy1DObj& y)
+  : _numpts( min(x.dim, y.dim) )
+{
+  // find bounds of finite points
+  _xmin = _ymin = 0.;
+  double xmax = 0., ymax = 0.;
+  bool first = true;
+  for(int i = 0; i < _numpts; ++i)
+    {
+      const double xv = x(i);
+      const double yv = y(i);
+      if( ! isFinite(xv) || ! isFinite(yv) )
+	continue;
+      if( first )
+	{
+	  _xmin = xmax = xv;
+	  _ymin = ymax = yv;
+	  first = false;
+	}
+      else
+	{
+	  _xmin = min(_xmin, xv); xmax = max(xmax, xv);
+	  _ymin = min(_ymin, yv); ymax = max(ymax, yv);
+	}
+    }
+
+  // aim for a few points per cell
+  const int dim = clipval( int(std::sqrt(_numpts/4.)), 1, MAXGRIDDIM );
+  _nx = _ny = dim;
+  _invcellw = (xmax > _xmin) ? _nx / (xmax - _xmin) : 0.;
+  _invcellh = (ymax > _ymin) ? _ny / (ymax - _ymin) : 0.;
+
+  // count points per cell, then convert counts to prefix offsets
+  _cellstart.fill(0, _nx*_ny+1);
+  for(int i = 0; i < _numpts; ++i)
+    {
+      const double xv = x(i);
+      const double yv = y(i);
+      if( ! isFinite(xv) || ! isFinite(yv) )
+	continue;
+      const int ix = clipval( int((xv-_xmin)*_invcellw), 0, _nx-1 );
+      const int iy = clipval( int((yv-_ymin)*_invcellh), 0, _ny-1 );
+      ++_cellstart[iy*_nx+ix+1];
+    }
+  for(int c = 1; c <= _nx*_ny; ++c)
+    _cellstart[c] += _cellstart[c-1];
+
+  // place point indices into cells (second pass keeps cells in
+  // increasing index order)
+  _indices.resize(_cellstart[_nx*_ny]);
+  QVector<int> fill(_cellstart);
+  for(int i = 0; i < _numpts; ++i)
+    {
+      const double xv = x(i);
+      const double yv = y(i);
+      if( ! isFinite(xv) || ! isFinite(yv) )
+	continue;
+      const int ix = clipval( int((xv-_xmin)*_invcellw), 0, _nx-1 );
+      const int iy = clipval( int((yv-_ymin)*_invcellh), 0, _ny-1 );
+      _indices[ fill[iy*_nx+ix]++ ] = i;
+    }
+}
+
+void PointIndex::pointsInRect(const QRectF& rect, QVector<int>& out) const
+{
+  if( _indices.isEmpty() )
+    return;
+
+  // range of cells overlapping the rectangle
+  const int ix1 = clipval( int((rect.left()-_xmin)*_invcellw), 0, _nx-1 );
+  const int ix2 = clipval( int((rect.right()-_xmin)*_invcellw), 0, _nx-1 );
+  const int iy1 = clipval( int((rect.top()-_ymin)*_invcellh), 0, _ny-1 );
+  const int iy2 = clipval( int((rect.bottom()-_ymin)*_invcellh), 0, _ny-1 );
+
+  const int startsize = out.size();
+  for(int iy = iy1; iy <= iy2; ++iy)
+    for(int ix = ix1; ix <= ix2; ++ix)
+      {
+	const int cell = iy*_nx+ix;
+	for(int c = _cellstart[cell]; c < _cellstart[cell+1]; ++c)
+	  out.append(_indices[c]);
+      }
+
+  // restore original drawing order across cells
+  qSort(out.begin()+startsize, out.end());
+}
@@ -0,0 +1,59 @@
+// -*- mode: C++; -*-
+
+#ifndef POINTINDEX_H
+#define POINTINDEX_H
+
+//    Copyright (C) 2012 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#include "qtloops_helpers.h"
+
+#include <QRectF>
+#include <QVector>
+
+// Uniform grid index over a set of points. Built once from the
+// coordinate arrays, then queried with the clip rectangle on each
+// redraw, so enumerating the visible points of a large dataset costs
+// time proportional to the number visible rather than the total.
+class PointIndex
+{
+public:
+  PointIndex(const Numpy1DObj& x, const Numpy1DObj& y);
+
+  // append indices of points in cells overlapping rect to out,
+  // in increasing index order (preserves drawing order)
+  void pointsInRect(const QRectF& rect, QVector<int>& out) const;
+
+  // number of points indexed
+  int size() const { return _numpts; }
+
+private:
+  int _numpts;
+
+  // grid dimensions and mapping from coordinates to cells
+  int _nx, _ny;
+  double _xmin, _ymin;
+  double _invcellw, _invcellh;
+
+  // point indices sorted by cell, with prefix offsets per cell
+  // (_cellstart has _nx*_ny+1 entries)
+  QVector<int> _cellstart;
+  QVector<int> _indices;
+};
+
+#endif
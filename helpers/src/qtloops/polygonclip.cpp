@@ -170,6 +170,25 @@ void polygonClip(const QPolygonF& inpoly,
   state.bottomClipPoint(state.bottom1st);
 }
 
+PolygonClipper::PolygonClipper(const QRectF& cliprect)
+  : _clip(cliprect)
+{
+}
+
+QPolygonF& PolygonClipper::scratchPoly()
+{
+  // resize keeps the allocation, unlike clear
+  _scratch.resize(0);
+  return _scratch;
+}
+
+const QPolygonF& PolygonClipper::clipped(const QPolygonF& poly)
+{
+  _out.resize(0);
+  polygonClip(poly, _clip, _out);
+  return _out;
+}
+
 void plotClippedPolygon(QPainter& painter,
 			QRectF rect,
 			const QPolygonF& inpoly,
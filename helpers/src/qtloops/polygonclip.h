@@ -31,6 +31,28 @@ void polygonClip(const QPolygonF& inpoly,
 		 const QRectF& cliprect,
 		 QPolygonF& outpoly);
 
+// clips batches of polygons against a single rectangle, reusing
+// scratch buffers between polygons so clipping thousands of polygons
+// does not allocate per polygon
+class PolygonClipper
+{
+public:
+  PolygonClipper(const QRectF& cliprect);
+
+  // empty scratch buffer for assembling the next input polygon
+  // (keeps its allocation between calls)
+  QPolygonF& scratchPoly();
+
+  // clip poly against the rectangle; the result is valid until the
+  // next call
+  const QPolygonF& clipped(const QPolygonF& poly);
+
+private:
+  QRectF _clip;
+  QPolygonF _scratch;
+  QPolygonF _out;
+};
+
 // plot a clipped polygon to painter
 void plotClippedPolygon(QPainter& painter,
 			QRectF rect,
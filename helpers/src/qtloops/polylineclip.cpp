@@ -21,8 +21,12 @@
 #include <cmath>
 
 #include <polylineclip.h>
+#include "instrument.h"
+#include "isnan.h"
+#include "linesimplify.h"
 
 using std::fabs;
+using std::floor;
 
 // Cohen-Sutherland line clipping algorithm
 
@@ -167,6 +171,68 @@ namespace
     return fabs(pt1.x() - pt2.x()) < 0.01 &&
       fabs(pt1.y()- pt2.y()) < 0.01;
   }
+
+  // polylines with more points than this are decimated before
+  // clipping and drawing
+  const int LODMINPOINTS = 10000;
+
+  // Reduce a dense polyline by collapsing each run of points falling
+  // within a single pixel-wide column of x into its first, minimum,
+  // maximum and last points. These four points paint the same pixels
+  // as the full run, but with far fewer segments.
+  QPolygonF decimatePolyline(const QPolygonF& poly)
+  {
+    QPolygonF out;
+
+    const int size = poly.size();
+    int i = 0;
+    while( i < size )
+      {
+	// non-finite points mark breaks in the line; pass them
+	// through one at a time, so they survive decimation and the
+	// loop always advances (nan never equals a column below)
+	if( ! isFinite(poly[i].x()) || ! isFinite(poly[i].y()) )
+	  {
+	    out << poly[i];
+	    ++i;
+	    continue;
+	  }
+
+	// find run of points within this pixel column, tracking the
+	// vertical extremes
+	const qreal column = floor(poly[i].x());
+	int minidx = i;
+	int maxidx = i;
+	int j = i;
+	while( j < size && isFinite(poly[j].y()) &&
+	       floor(poly[j].x()) == column )
+	  {
+	    if( poly[j].y() < poly[minidx].y() ) minidx = j;
+	    if( poly[j].y() > poly[maxidx].y() ) maxidx = j;
+	    ++j;
+	  }
+
+	if( j-i <= 4 )
+	  {
+	    // nothing to gain from decimating short runs
+	    for( ; i < j; ++i )
+	      out << poly[i];
+	  }
+	else
+	  {
+	    // keep extremes in original drawing order
+	    out << poly[i];
+	    if( minidx < maxidx )
+	      out << poly[minidx] << poly[maxidx];
+	    else
+	      out << poly[maxidx] << poly[minidx];
+	    out << poly[j-1];
+	  }
+	i = j;
+      }
+
+    return out;
+  }
 }
 
 bool clipLine(const QRectF& clip, QPointF& pt1, QPointF& pt2)
@@ -180,6 +246,9 @@ void plotClippedPolyline(QPainter& painter,
 			 const QPolygonF& poly,
 			 bool autoexpand)
 {
+  InstrumentScope instr(InstrClippedPolyline);
+  instr.addPointsIn(poly.size());
+
   // exit if fewer than 2 points in polygon
   if ( poly.size() < 2 )
     return;
@@ -191,17 +260,30 @@ void plotClippedPolyline(QPainter& painter,
       clip.adjust(-lw, -lw, lw, lw);
     }
 
+  // decimate very dense polylines before clipping
+  QPolygonF decimated;
+  if( poly.size() > LODMINPOINTS )
+    {
+      decimated = decimatePolyline(poly);
+      if( decimated.size() > LODMINPOINTS )
+	// still dense after column decimation (e.g. diagonal paths),
+	// so drop points deviating less than a fraction of a pixel
+	decimated = simplifyPolyline(decimated, 0.25);
+    }
+  const QPolygonF& usepoly = decimated.isEmpty() ? poly : decimated;
+  instr.addPointsOut(usepoly.size());
+
   // work is done by the clipping object
   Clipper clipper(clip);
 
   // output goes here
   QPolygonF pout;
 
-  QPolygonF::const_iterator i = poly.begin();
+  QPolygonF::const_iterator i = usepoly.begin();
   QPointF lastpt = *i;
   i++;
 
-  for( ; i != poly.end(); ++i )
+  for( ; i != usepoly.end(); ++i )
     {
       QPointF p1 = lastpt;
       QPointF p2 = *i;
@@ -228,7 +310,10 @@ void plotClippedPolyline(QPainter& painter,
 		{
 		  // paint existing line
 		  if( pout.size() >= 2 )
-		    painter.drawPolyline(pout);
+		    {
+		      instr.addDrawCall();
+		      painter.drawPolyline(pout);
+		    }
 
 		  // start new line
 		  pout.clear();
@@ -244,7 +329,10 @@ void plotClippedPolyline(QPainter& painter,
 
 	  // paint existing line
 	  if( pout.size() >= 2 )
-	    painter.drawPolyline(pout);
+	    {
+	      instr.addDrawCall();
+	      painter.drawPolyline(pout);
+	    }
 
 	  // cleanup
 	  pout.clear();
@@ -255,5 +343,8 @@ void plotClippedPolyline(QPainter& painter,
     }
 
   if( pout.size() >= 2 )
-    painter.drawPolyline(pout);
+    {
+      instr.addDrawCall();
+      painter.drawPolyline(pout);
+    }
 }
@@ -18,10 +18,12 @@
 
 #include "qtloops.h"
 #include "isnan.h"
+#include "instrument.h"
 #include "polylineclip.h"
 #include "polygonclip.h"
 
 #include <math.h>
+#include <limits>
 
 #include <QPointF>
 #include <QVector>
@@ -29,6 +31,11 @@
 #include <QPen>
 #include <QTransform>
 #include <QColor>
+#include <QHash>
+#include <QPaintEngine>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 
 namespace
 {
@@ -55,12 +62,278 @@ namespace
     if( val > maxv ) return maxv;
     return val;
   }
+
+  // number of discrete scale buckets per unit scale factor for
+  // rasterized markers
+  const int SCALESTEPS = 16;
+
+  // largest marker size (pixels) kept in the atlas - bigger markers
+  // fall back to path drawing
+  const int MAXMARKERSIZE = 512;
+
+  // round scale factor to nearest bucket
+  inline int scaleBucket(qreal s)
+  {
+    return int(s*SCALESTEPS + 0.5);
+  }
+
+  // Rasterizes a marker path once per scale bucket and blits the
+  // image for each point, rather than re-tessellating the path
+  // millions of times. Only used for raster output devices - vector
+  // devices keep the original path drawing.
+  class MarkerAtlas
+  {
+  public:
+    MarkerAtlas(const QPainter& painter, const QPainterPath& path)
+      : _path(path),
+	_pathbox(path.boundingRect()),
+	_pen(painter.pen()), _brush(painter.brush()),
+	_hints(painter.renderHints())
+    {
+      // rasterize at device resolution, so only allow simple
+      // scaling transformations
+      const QTransform& t = painter.worldTransform();
+      _sx = t.m11();
+      _sy = t.m22();
+      _valid = painter.paintEngine() != 0 &&
+	painter.paintEngine()->type() == QPaintEngine::Raster &&
+	_sx > 0. && _sy > 0. && t.m12() == 0. && t.m21() == 0.;
+    }
+
+    bool valid() const { return _valid; }
+
+    // blit marker for scale bucket at device coordinates devpt
+    // painter world transform must be identity
+    // returns false if the marker is too large for the atlas
+    bool blit(QPainter& painter, const QPointF& devpt, int bucket)
+    {
+      QHash<int, Marker>::iterator i = _markers.find(bucket);
+      if( i == _markers.end() )
+	i = _markers.insert(bucket, rasterize(bucket*(1./SCALESTEPS)));
+      if( i->image.isNull() )
+	return false;
+      painter.drawImage(devpt - i->origin, i->image);
+      return true;
+    }
+
+  private:
+    struct Marker
+    {
+      QImage image;
+      // position of path origin within image
+      QPointF origin;
+    };
+
+    // draw path into small image for scale factor given
+    Marker rasterize(qreal s) const
+    {
+      Marker m;
+
+      // allow for pen width around the path bounding box
+      const qreal margin = _pen.widthF()*qMax(_sx, _sy)*s + 2.;
+      const qreal w = _pathbox.width()*_sx*s;
+      const qreal h = _pathbox.height()*_sy*s;
+      if( w+2*margin > MAXMARKERSIZE || h+2*margin > MAXMARKERSIZE )
+	// too big to be worth caching
+	return m;
+
+      m.origin = QPointF(margin - _pathbox.left()*_sx*s,
+			 margin - _pathbox.top()*_sy*s);
+      m.image = QImage( int(w+2*margin)+1, int(h+2*margin)+1,
+			QImage::Format_ARGB32_Premultiplied );
+      m.image.fill(0);
+
+      QPainter p(&m.image);
+      p.setRenderHints(_hints);
+      p.setPen(_pen);
+      p.setBrush(_brush);
+      p.translate(m.origin);
+      p.scale(_sx*s, _sy*s);
+      p.drawPath(_path);
+      p.end();
+      return m;
+    }
+
+    QPainterPath _path;
+    QRectF _pathbox;
+    QPen _pen;
+    QBrush _brush;
+    QPainter::RenderHints _hints;
+    qreal _sx, _sy;
+    bool _valid;
+    QHash<int, Marker> _markers;
+  };
+
+  // number of entries in precomputed color table used for large images
+  const int LUTSIZE = 1024;
+  // images with fewer pixels than this are converted with exact
+  // per-pixel interpolation in a single thread
+  const int LUTMINPIXELS = 256*256;
+
+  // convert a block of image scanlines using a precomputed color table
+  class ScanLineTask : public QRunnable
+  {
+  public:
+    ScanLineTask(QImage& img, const Numpy2DObj& imgdata,
+		 const Numpy2DObj* transimg,
+		 const QRgb* lut, int ystart, int yend)
+      : _img(img), _imgdata(imgdata), _transimg(transimg), _lut(lut),
+	_ystart(ystart), _yend(yend)
+    {
+      setAutoDelete(false);
+    }
+
+    void run()
+    {
+      const int xw = _imgdata.dims[1];
+      const int yw = _imgdata.dims[0];
+      for(int y=_ystart; y<_yend; ++y)
+	{
+	  // direction of images is different for qt and numpy image
+	  QRgb* scanline = reinterpret_cast<QRgb*>(_img.scanLine(yw-y-1));
+	  for(int x=0; x<xw; ++x)
+	    {
+	      const double val = _imgdata(x, y);
+	      if( ! isFinite(val) )
+		// transparent
+		*(scanline+x) = qRgba(0, 0, 0, 0);
+	      else
+		{
+		  QRgb col = _lut[ clipval(int(val*(LUTSIZE-1)),
+					   0, LUTSIZE-1) ];
+		  if( _transimg != 0 )
+		    {
+		      // scale alpha by transparency image
+		      const double f = clipval((*_transimg)(x, y), 0., 1.);
+		      col = qRgba( qRed(col), qGreen(col), qBlue(col),
+				   int(qAlpha(col)*f) );
+		    }
+		  *(scanline+x) = col;
+		}
+	    }
+	}
+    }
+
+  private:
+    QImage& _img;
+    const Numpy2DObj& _imgdata;
+    const Numpy2DObj* _transimg;
+    const QRgb* _lut;
+    int _ystart, _yend;
+  };
+
+  // interpolate colors table into a fixed-size lookup table
+  void buildColorLUT(const Numpy2DIntObj& colors, QRgb* lut)
+  {
+    const int numbands = colors.dims[0]-1;
+    for(int i=0; i<LUTSIZE; ++i)
+      {
+	const double val = i * (1./(LUTSIZE-1));
+	const int band = clipval(int(val*numbands), 0, numbands-1);
+	const double delta = val*numbands - band;
+
+	// ensure we don't read beyond where we should
+	const int band2 = min(band + 1, numbands);
+	const double delta1 = 1.-delta;
+
+	const int b = int(delta1*colors(0, band) +
+			  delta *colors(0, band2));
+	const int g = int(delta1*colors(1, band) +
+			  delta *colors(1, band2));
+	const int r = int(delta1*colors(2, band) +
+			  delta *colors(2, band2));
+	const int a = int(delta1*colors(3, band) +
+			  delta *colors(3, band2));
+	lut[i] = qRgba(r, g, b, a);
+      }
+  }
+
+  // draw paths for points colored from a Nx1 image, grouping points
+  // by color so each distinct color constructs and sets its brush
+  // once rather than per point
+  void plotColoredPaths(QPainter& painter, const QPainterPath& path,
+			const Numpy1DObj& x, const Numpy1DObj& y,
+			const Numpy1DObj* scaling,
+			const QRectF& cliprect,
+			const QImage& colorimg,
+			const QVector<int>* candidates,
+			int size)
+  {
+    // read colors straight from the scanline where the format allows
+    const QRgb* scan =
+      ( colorimg.format() == QImage::Format_ARGB32 ||
+	colorimg.format() == QImage::Format_RGB32 ) ?
+      reinterpret_cast<const QRgb*>(colorimg.scanLine(0)) : 0;
+
+    // collect visible points per color, keeping groups in order of
+    // first appearance so the output is deterministic
+    QHash<QRgb, int> colorgroup;
+    QVector<QRgb> groupcolors;
+    QVector<QVector<int> > grouppoints;
+
+    const int numiters = candidates != 0 ? candidates->size() : size;
+    for(int c = 0; c < numiters; ++c)
+      {
+	const int i = candidates != 0 ? (*candidates)[c] : c;
+	if( i >= size )
+	  continue;
+	const QPointF pt(x(i), y(i));
+	if( ! cliprect.contains(pt) )
+	  continue;
+
+	const QRgb col = scan != 0 ? scan[i] : colorimg.pixel(i, 0);
+	int group = colorgroup.value(col, -1);
+	if( group < 0 )
+	  {
+	    group = grouppoints.size();
+	    colorgroup.insert(col, group);
+	    groupcolors.append(col);
+	    grouppoints.append(QVector<int>());
+	  }
+	grouppoints[group].append(i);
+      }
+
+    const QTransform origtrans(painter.worldTransform());
+    for(int g = 0; g < grouppoints.size(); ++g)
+      {
+	painter.setBrush( QBrush(QColor::fromRgba(groupcolors[g])) );
+
+	QPointF lastpt(-1e6, -1e6);
+	const QVector<int>& pts = grouppoints[g];
+	for(int p = 0; p < pts.size(); ++p)
+	  {
+	    const int i = pts[p];
+	    const QPointF pt(x(i), y(i));
+	    if( smallDelta(lastpt, pt) )
+	      continue;
+
+	    painter.translate(pt);
+	    if( scaling != 0 )
+	      {
+		// scale point if requested
+		const qreal s = (*scaling)(i);
+		painter.scale(s, s);
+	      }
+	    painter.drawPath(path);
+	    painter.setWorldTransform(origtrans);
+	    lastpt = pt;
+	  }
+      }
+  }
 }
 
 void addNumpyToPolygonF(QPolygonF& poly, const Tuple2Ptrs& d)
 {
   // iterate over rows until none left
   const int numcols = d.data.size();
+
+  // preallocate room for every possible point, so appending below
+  // never has to grow the polygon
+  int maxpts = 0;
+  for(int col=0; col < (numcols-1); col += 2)
+    maxpts += min( d.dims[col], d.dims[col+1] );
+  poly.reserve( poly.size() + maxpts );
+
   QPointF lastpt(-1e6, -1e6);
   for(int row=0 ; ; ++row)
     {
@@ -90,11 +363,16 @@ void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
 			   const QRectF* clip)
 {
   const int numcols = d.data.size();
+
+  // clipper owns polygon buffers reused from row to row, so clipping
+  // many polygons doesn't allocate per polygon
+  PolygonClipper clipper( clip != 0 ? *clip : QRectF() );
+
   for(int row=0 ; ; ++row)
     {
       bool ifany = false;
       // output polygon
-      QPolygonF poly;
+      QPolygonF& poly = clipper.scratchPoly();
 
       // the numcols-1 makes sure we don't get odd numbers of columns
       for(int col=0; col < (numcols-1); col += 2)
@@ -111,15 +389,9 @@ void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
       if( ifany )
 	{
 	  if( clip != 0 )
-	    {
-	      QPolygonF clippedpoly;
-	      polygonClip(poly, *clip, clippedpoly);
-	      path.addPolygon(clippedpoly);
-	    }
+	    path.addPolygon( clipper.clipped(poly) );
 	  else
-	    {
-	      path.addPolygon(poly);
-	    }
+	    path.addPolygon(poly);
 	  path.closeSubpath();
 	}
       else
@@ -134,8 +406,11 @@ void plotPathsToPainter(QPainter& painter, QPainterPath& path,
 			const Numpy1DObj& x, const Numpy1DObj& y,
 			const Numpy1DObj* scaling,
 			const QRectF* clip,
-			const QImage* colorimg)
+			const QImage* colorimg,
+			const PointIndex* index)
 {
+  InstrumentScope instr(InstrPlotPaths);
+
   QRectF cliprect( QPointF(-32767,-32767), QPointF(32767,32767) );
   if( clip != 0 )
     {
@@ -162,28 +437,68 @@ void plotPathsToPainter(QPainter& painter, QPainterPath& path,
   if( scaling != 0 )
     size = min(size, scaling->dim);
 
+  instr.addPointsIn(size);
+
+  // per-point brushes change appearance, so the atlas only handles
+  // markers with fixed pen and brush
+  MarkerAtlas atlas(painter, path);
+  const bool useatlas = atlas.valid();
+
+  // if an index over these points was supplied, enumerate only the
+  // points in cells overlapping the clip rectangle
+  const bool useindex = index != 0 && index->size() == min(x.dim, y.dim);
+  QVector<int> candidates;
+  if( useindex )
+    index->pointsInRect(cliprect, candidates);
+
+  // per-point colors are handled by the batched path, which groups
+  // points by color to avoid a brush change per point
+  if( colorimg != 0 )
+    {
+      plotColoredPaths(painter, path, x, y, scaling, cliprect, *colorimg,
+		       useindex ? &candidates : 0, size);
+      return;
+    }
+
   // draw each path
-  for(int i = 0; i < size; ++i)
+  const int numiters = useindex ? candidates.size() : size;
+  for(int c = 0; c < numiters; ++c)
     {
+      const int i = useindex ? candidates[c] : c;
+      if( i >= size )
+	continue;
+
       const QPointF pt(x(i), y(i));
       if( cliprect.contains(pt) && ! smallDelta(lastpt, pt) )
 	{
-	  painter.translate(pt);
-	  if( scaling != 0 )
+	  bool drawn = false;
+	  if( useatlas )
 	    {
-	      // scale point if requested
-	      const qreal s = (*scaling)(i);
-	      painter.scale(s, s);
+	      const int bucket = (scaling != 0) ?
+		scaleBucket((*scaling)(i)) : SCALESTEPS;
+	      if( bucket > 0 )
+		{
+		  // blit in device coordinates
+		  painter.setWorldTransform(QTransform());
+		  drawn = atlas.blit(painter, origtrans.map(pt), bucket);
+		  painter.setWorldTransform(origtrans);
+		}
 	    }
-	  if( colorimg != 0 )
+
+	  if( ! drawn )
 	    {
-	      // get color from pixel and create a new brush
-	      QBrush b( QColor::fromRgba(colorimg->pixel(i, 0)) );
-	      painter.setBrush(b);
+	      painter.translate(pt);
+	      if( scaling != 0 )
+		{
+		  // scale point if requested
+		  const qreal s = (*scaling)(i);
+		  painter.scale(s, s);
+		}
+	      painter.drawPath(path);
+	      painter.setWorldTransform(origtrans);
 	    }
-
-	  painter.drawPath(path);
-	  painter.setWorldTransform(origtrans);
+	  instr.addPointsOut(1);
+	  instr.addDrawCall();
 	  lastpt = pt;
 	}
     }
@@ -192,9 +507,13 @@ void plotPathsToPainter(QPainter& painter, QPainterPath& path,
 void plotLinesToPainter(QPainter& painter,
 			const Numpy1DObj& x1, const Numpy1DObj& y1,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
-			const QRectF* clip, bool autoexpand)
+			const QRectF* clip, bool autoexpand,
+			const FiniteRuns* runs)
 {
+  InstrumentScope instr(InstrPlotLines);
+
   const int maxsize = min(x1.dim, x2.dim, y1.dim, y2.dim);
+  instr.addPointsIn(maxsize);
 
   // if autoexpand, expand rectangle by line width
   QRectF clipcopy;
@@ -210,28 +529,84 @@ void plotLinesToPainter(QPainter& painter,
   if( maxsize != 0 )
     {
       QVector<QLineF> lines;
-      for(int i = 0; i < maxsize; ++i)
+      const int numruns = (runs != 0) ? runs->size() : 1;
+      for(int r = 0; r < numruns; ++r)
 	{
-	  QPointF pt1(x1(i), y1(i));
-	  QPointF pt2(x2(i), y2(i));
-	  if( clip != 0 )
+	  int i = 0;
+	  int end = maxsize;
+	  if( runs != 0 )
 	    {
-	      if( clipLine(clipcopy, pt1, pt2) )
+	      i = runs->start[r];
+	      end = min(runs->start[r] + runs->len[r], maxsize);
+	    }
+	  for( ; i < end; ++i)
+	    {
+	      QPointF pt1(x1(i), y1(i));
+	      QPointF pt2(x2(i), y2(i));
+	      if( clip != 0 )
+		{
+		  if( clipLine(clipcopy, pt1, pt2) )
+		    lines << QLineF(pt1, pt2);
+		}
+	      else
 		lines << QLineF(pt1, pt2);
 	    }
-	  else
-	    lines << QLineF(pt1, pt2);
 	}
 
+      instr.addPointsOut(lines.size());
+      instr.addDrawCall();
       painter.drawLines(lines);
     }
 }
 
+namespace
+{
+  // only coalesce draw lists longer than this; small lists draw
+  // quickly anyway and keep their exact geometry
+  const int COALESCEMINRECTS = 10000;
+
+  // merge rectangles covering the same pixel columns which touch or
+  // overlap vertically; as all rects share one pen and brush, the
+  // union paints the same pixels as the separate (and any fully
+  // occluded) rects did
+  void coalesceRects(const QVector<QRectF>& in, QVector<QRectF>& out)
+  {
+    // rect in out currently accumulating each pair of pixel columns
+    QHash<qint64, int> lastincols;
+
+    for(int i = 0; i < in.size(); ++i)
+      {
+	const QRectF& r = in[i];
+	const int c1 = int(floor(r.left()));
+	const int c2 = int(floor(r.right()));
+	const qint64 key = (qint64(c1) << 32) | quint32(c2);
+
+	const int idx = lastincols.value(key, -1);
+	if( idx >= 0 )
+	  {
+	    QRectF& prev = out[idx];
+	    if( r.top() <= prev.bottom()+0.5 && r.bottom() >= prev.top()-0.5 )
+	      {
+		// touches vertically, so extend the accumulated rect
+		prev = prev.united(r);
+		continue;
+	      }
+	  }
+
+	out.append(r);
+	lastincols.insert(key, out.size()-1);
+      }
+  }
+}
+
 void plotBoxesToPainter(QPainter& painter,
 			const Numpy1DObj& x1, const Numpy1DObj& y1,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
-			const QRectF* clip, bool autoexpand)
+			const QRectF* clip, bool autoexpand,
+			const FiniteRuns* runs)
 {
+  InstrumentScope instr(InstrPlotBoxes);
+
   // if autoexpand, expand rectangle by line width
   QRectF clipcopy(QPointF(-32767,-32767), QPointF(32767,32767));
   if ( clip != 0 && autoexpand )
@@ -244,37 +619,173 @@ void plotBoxesToPainter(QPainter& painter,
     }
 
   const int maxsize = min(x1.dim, x2.dim, y1.dim, y2.dim);
+  instr.addPointsIn(maxsize);
 
   QVector<QRectF> rects;
-  for(int i = 0; i < maxsize; ++i)
+  const int numruns = (runs != 0) ? runs->size() : 1;
+  for(int r = 0; r < numruns; ++r)
+    {
+      int i = 0;
+      int end = maxsize;
+      if( runs != 0 )
+	{
+	  i = runs->start[r];
+	  end = min(runs->start[r] + runs->len[r], maxsize);
+	}
+      for( ; i < end; ++i)
+	{
+	  QPointF pt1(x1(i), y1(i));
+	  QPointF pt2(x2(i), y2(i));
+	  const QRectF rect(pt1, pt2);
+
+	  if( clipcopy.intersects(rect) )
+	    {
+	      rects << clipcopy.intersected(rect);
+	    }
+	}
+    }
+
+  if( ! rects.isEmpty() )
+    {
+      if( rects.size() > COALESCEMINRECTS )
+	{
+	  // dense bar or candle charts collapse into a draw list
+	  // closer to the number of visible pixel columns
+	  QVector<QRectF> merged;
+	  coalesceRects(rects, merged);
+	  instr.addPointsOut(merged.size());
+	  instr.addDrawCall();
+	  painter.drawRects(merged);
+	}
+      else
+	{
+	  instr.addPointsOut(rects.size());
+	  instr.addDrawCall();
+	  painter.drawRects(rects);
+	}
+    }
+}
+
+void clipLineSegments(const QRectF& cliprect,
+		      const Numpy1DObj& x1, const Numpy1DObj& y1,
+		      const Numpy1DObj& x2, const Numpy1DObj& y2,
+		      int* numout,
+		      double** outx1, double** outy1,
+		      double** outx2, double** outy2)
+{
+  const int size = min(x1.dim, y1.dim, x2.dim, y2.dim);
+  *numout = size;
+
+  double* ox1 = *outx1 = new double[size];
+  double* oy1 = *outy1 = new double[size];
+  double* ox2 = *outx2 = new double[size];
+  double* oy2 = *outy2 = new double[size];
+
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+
+  for(int i = 0; i < size; ++i)
     {
       QPointF pt1(x1(i), y1(i));
       QPointF pt2(x2(i), y2(i));
-      const QRectF rect(pt1, pt2);
-
-      if( clipcopy.intersects(rect) )
+      if( clipLine(cliprect, pt1, pt2) )
 	{
-	  rects << clipcopy.intersected(rect);
+	  ox1[i] = pt1.x(); oy1[i] = pt1.y();
+	  ox2[i] = pt2.x(); oy2[i] = pt2.y();
+	}
+      else
+	{
+	  // segment rejected
+	  ox1[i] = oy1[i] = ox2[i] = oy2[i] = nan;
 	}
     }
+}
 
-  if( ! rects.isEmpty() )
-    painter.drawRects(rects);
+namespace
+{
+  // nan-aware box-filter reduction of a 2D array to the target size
+  // each output value averages the finite input values falling in
+  // its box; all-nan boxes stay nan
+  // walks the input in row order so access stays cache friendly
+  void downsampleArray(const Numpy2DObj& in, int outw, int outh,
+		       QVector<double>& out)
+  {
+    QVector<double> sum(outw*outh, 0.);
+    QVector<int> count(outw*outh, 0);
+
+    for(int y = 0; y < in.dims[0]; ++y)
+      {
+	const int oy = int( y*qint64(outh) / in.dims[0] );
+	double* sumrow = sum.data() + oy*outw;
+	int* ctrow = count.data() + oy*outw;
+	for(int x = 0; x < in.dims[1]; ++x)
+	  {
+	    const double v = in(x, y);
+	    if( isFinite(v) )
+	      {
+		const int ox = int( x*qint64(outw) / in.dims[1] );
+		sumrow[ox] += v;
+		ctrow[ox] += 1;
+	      }
+	  }
+      }
+
+    out.resize(outw*outh);
+    for(int i = 0; i < outw*outh; ++i)
+      out[i] = count[i] > 0 ? sum[i]/count[i] :
+	std::numeric_limits<double>::quiet_NaN();
+  }
 }
 
 QImage numpyToQImage(const Numpy2DObj& imgdata, const Numpy2DIntObj &colors,
-		     bool forcetrans)
+		     bool forcetrans, const Numpy2DObj* transimg,
+		     int targetwidth, int targetheight)
 {
+  // the nested call below is covered by this scope, as only the
+  // outermost scope per function accumulates
+  InstrumentScope instr(InstrNumpyToQImage);
+  instr.addPointsIn(qint64(imgdata.dims[0])*imgdata.dims[1]);
+
+  // arrays much larger than the displayed size are reduced first, so
+  // conversion and the painter blit scale with screen pixels rather
+  // than data pixels; averaging happens before the colormap is
+  // applied
+  if( targetwidth > 0 && targetheight > 0 &&
+      (targetwidth < imgdata.dims[1] || targetheight < imgdata.dims[0]) )
+    {
+      const int outw = min(targetwidth, imgdata.dims[1]);
+      const int outh = min(targetheight, imgdata.dims[0]);
+      instr.addPointsOut(qint64(outw)*outh);
+
+      QVector<double> reduced;
+      downsampleArray(imgdata, outw, outh, reduced);
+      const Numpy2DObj reducedobj(reduced.constData(), outh, outw);
+
+      if( transimg != 0 )
+	{
+	  QVector<double> reducedtrans;
+	  downsampleArray(*transimg, outw, outh, reducedtrans);
+	  const Numpy2DObj reducedtransobj(reducedtrans.constData(),
+					   outh, outw);
+	  return numpyToQImage(reducedobj, colors, forcetrans,
+			       &reducedtransobj);
+	}
+      return numpyToQImage(reducedobj, colors, forcetrans);
+    }
+
   // make format use alpha transparency if required
   const int numcolors = colors.dims[0];
   if ( colors.dims[1] != 4 )
     throw "4 columns required in colors array";
+  if ( transimg != 0 && (transimg->dims[0] != imgdata.dims[0] ||
+			 transimg->dims[1] != imgdata.dims[1]) )
+    throw "Transparency array must match data dimensions";
   const int numbands = numcolors-1;
   const int xw = imgdata.dims[1];
   const int yw = imgdata.dims[0];
+  instr.addPointsOut(qint64(xw)*yw);
 
   QImage::Format format = QImage::Format_RGB32;
-  if( forcetrans )
+  if( forcetrans || transimg != 0 )
     format = QImage::Format_ARGB32;
   else
     {
@@ -288,6 +799,34 @@ QImage numpyToQImage(const Numpy2DObj& imgdata, const Numpy2DIntObj &colors,
   // make image
   QImage img(xw, yw, format);
 
+  // for large images interpolation is precomputed into a lookup
+  // table and scanlines are converted across a thread pool, as rows
+  // are independent of each other
+  const int numthreads = QThread::idealThreadCount();
+  if( xw*yw >= LUTMINPIXELS && numthreads > 1 )
+    {
+      QRgb lut[LUTSIZE];
+      buildColorLUT(colors, lut);
+
+      // split rows into a block per thread
+      QThreadPool pool;
+      QVector<ScanLineTask*> tasks;
+      const int blocksize = yw/numthreads + 1;
+      for(int y=0; y<yw; y += blocksize)
+	{
+	  ScanLineTask* task =
+	    new ScanLineTask(img, imgdata, transimg, lut,
+			     y, min(y+blocksize, yw));
+	  tasks.push_back(task);
+	  pool.start(task);
+	}
+      pool.waitForDone();
+      foreach(ScanLineTask* task, tasks)
+	delete task;
+
+      return img;
+    }
+
   // iterate over input pixels
   for(int y=0; y<yw; ++y)
     {
@@ -319,9 +858,13 @@ QImage numpyToQImage(const Numpy2DObj& imgdata, const Numpy2DIntObj &colors,
 				delta *colors(1, band2));
 	      const int r = int(delta1*colors(2, band) +
 				delta *colors(2, band2));
-	      const int a = int(delta1*colors(3, band) +
-				delta *colors(3, band2));
-	      
+	      int a = int(delta1*colors(3, band) +
+			  delta *colors(3, band2));
+
+	      // apply transparency image in same pass
+	      if( transimg != 0 )
+		a = int( a * clipval((*transimg)(x, y), 0., 1.) );
+
 	      *(scanline+x) = qRgba(r, g, b, a);
 	    }
 	}
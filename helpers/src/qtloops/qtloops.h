@@ -22,6 +22,7 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "qtloops_helpers.h"
+#include "pointindex.h"
 
 #include <QPolygonF>
 #include <QPainter>
@@ -47,24 +48,50 @@ void addNumpyPolygonToPath(QPainterPath &path, const Tuple2Ptrs& d,
 // if scaling is not 0, is an array to scale the data points by
 // if colorimg is not 0, is a Nx1 image containing color points for path fills
 // clip is a clipping rectangle if set
+// if index is not 0, is a spatial index over x and y used to
+// enumerate only the points near the clipping rectangle
 void plotPathsToPainter(QPainter& painter, QPainterPath& path,
 			const Numpy1DObj& x, const Numpy1DObj& y,
 			const Numpy1DObj* scaling = 0,
 			const QRectF* clip = 0,
-			const QImage* colorimg = 0);
+			const QImage* colorimg = 0,
+			const PointIndex* index = 0);
 
+// if runs is not 0, it indexes the spans finite in all four arrays
+// and only those spans are visited, so nan gaps never reach the
+// per-segment clipping
 void plotLinesToPainter(QPainter& painter,
 			const Numpy1DObj& x1, const Numpy1DObj& y1,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
-			const QRectF* clip = 0, bool autoexpand = true);
+			const QRectF* clip = 0, bool autoexpand = true,
+			const FiniteRuns* runs = 0);
 
 void plotBoxesToPainter(QPainter& painter,
 			const Numpy1DObj& x1, const Numpy1DObj& y1,
 			const Numpy1DObj& x2, const Numpy1DObj& y2,
-			const QRectF* clip = 0, bool autoexpand = true);
+			const QRectF* clip = 0, bool autoexpand = true,
+			const FiniteRuns* runs = 0);
 
+// clip line segments (x1,y1)->(x2,y2) against cliprect in one pass
+// clipped endpoints are written to the four output arrays
+// segments entirely outside the rectangle get nan endpoints
+void clipLineSegments(const QRectF& cliprect,
+		      const Numpy1DObj& x1, const Numpy1DObj& y1,
+		      const Numpy1DObj& x2, const Numpy1DObj& y2,
+		      int* numout,
+		      double** outx1, double** outy1,
+		      double** outx2, double** outy2);
+
+// convert data to an image using the colors table given
+// if transimg is not 0, it is a per-pixel transparency array (0 to 1)
+// applied to the alpha channel during conversion
+// if targetwidth/targetheight are positive and smaller than the data,
+// the data (and transimg) are first reduced by nan-aware box-filter
+// averaging so the output is no larger than the displayed size
 QImage numpyToQImage(const Numpy2DObj& data, const Numpy2DIntObj &colors,
-		     bool forcetrans = false);
+		     bool forcetrans = false,
+		     const Numpy2DObj* transimg = 0,
+		     int targetwidth = -1, int targetheight = -1);
 
 void applyImageTransparancy(QImage& img, const Numpy2DObj& data);
 
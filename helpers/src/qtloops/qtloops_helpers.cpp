@@ -20,6 +20,11 @@
 #include "numpy/arrayobject.h"
 
 #include "qtloops_helpers.h"
+#include "isnan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 void do_numpy_init_package()
 {
@@ -59,9 +64,42 @@ Tuple2Ptrs::~Tuple2Ptrs()
     }
 }
 
+namespace
+{
+  // is this an array we can use in place without conversion?
+  // needs native, aligned doubles with strides in whole elements
+  inline bool isNativeDoubleArray(PyObject* obj, int nd)
+  {
+    if( ! PyArray_Check(obj) )
+      return false;
+    PyArrayObject* a = (PyArrayObject*)obj;
+    if( a->nd != nd || a->descr->type_num != PyArray_DOUBLE ||
+	! PyArray_ISALIGNED(a) || ! PyArray_ISNOTSWAPPED(a) )
+      return false;
+    for(int i = 0; i < nd; ++i)
+      {
+	if( a->strides[i] % int(sizeof(double)) != 0 )
+	  return false;
+      }
+    return true;
+  }
+}
+
 Numpy1DObj::Numpy1DObj(PyObject* array)
-  : data(0), _array(0)
+  : data(0), stride(1), _array(0)
 {
+  // use strided array data in place if possible (zero copy)
+  if( isNativeDoubleArray(array, 1) )
+    {
+      PyArrayObject* arrayobj = (PyArrayObject*)array;
+      Py_INCREF(array);
+      _array = array;
+      data = (double*)(arrayobj->data);
+      dim = arrayobj->dimensions[0];
+      stride = arrayobj->strides[0] / int(sizeof(double));
+      return;
+    }
+
   PyArrayObject *arrayobj = (PyArrayObject*)
     PyArray_ContiguousFromObject(array, PyArray_DOUBLE, 1, 1);
   if( arrayobj == NULL )
@@ -84,6 +122,20 @@ Numpy1DObj::~Numpy1DObj()
 Numpy2DObj::Numpy2DObj(PyObject* array)
   : data(0), _array(0)
 {
+  // use strided array data in place if possible (zero copy)
+  if( isNativeDoubleArray(array, 2) )
+    {
+      PyArrayObject* arrayobj = (PyArrayObject*)array;
+      Py_INCREF(array);
+      _array = array;
+      data = (double*)(arrayobj->data);
+      dims[0] = arrayobj->dimensions[0];
+      dims[1] = arrayobj->dimensions[1];
+      strides[0] = arrayobj->strides[0] / int(sizeof(double));
+      strides[1] = arrayobj->strides[1] / int(sizeof(double));
+      return;
+    }
+
   PyArrayObject *arrayobj = (PyArrayObject*)
     PyArray_ContiguousFromObject(array, PyArray_DOUBLE, 2, 2);
 
@@ -95,9 +147,20 @@ Numpy2DObj::Numpy2DObj(PyObject* array)
   data = (double*)(arrayobj->data);
   dims[0] = arrayobj->dimensions[0];
   dims[1] = arrayobj->dimensions[1];
+  strides[0] = dims[1];
+  strides[1] = 1;
   _array = (PyObject*)arrayobj;
 }
 
+Numpy2DObj::Numpy2DObj(const double* d, int dimy, int dimx)
+  : data(d), _array(0)
+{
+  dims[0] = dimy;
+  dims[1] = dimx;
+  strides[0] = dimx;
+  strides[1] = 1;
+}
+
 Numpy2DObj::~Numpy2DObj()
 {
   Py_XDECREF(_array);
@@ -130,6 +193,138 @@ Numpy2DIntObj::~Numpy2DIntObj()
   data = 0;
 }
 
+namespace
+{
+  // buffer pointer and length of a numpy array, used by DatasetHandle
+  // to spot arrays rebound to new storage
+  inline void arrayIdentity(PyObject* obj, const void** rawptr, int* rawdim)
+  {
+    *rawptr = 0;
+    *rawdim = -1;
+    if( PyArray_Check(obj) )
+      {
+	PyArrayObject* a = (PyArrayObject*)obj;
+	*rawptr = a->data;
+	if( a->nd == 1 )
+	  *rawdim = a->dimensions[0];
+      }
+  }
+}
+
+void computeFiniteRuns(const Numpy1DObj& d, FiniteRuns& out)
+{
+  // resize keeps the allocation, unlike clear
+  out.start.resize(0);
+  out.len.resize(0);
+
+  const int n = d.dim;
+  int i = 0;
+  while( i < n )
+    {
+      // find the start of the next run
+      while( i < n && ! isFinite(d(i)) )
+	++i;
+      if( i == n )
+	break;
+      const int runstart = i;
+
+#ifdef __SSE2__
+      if( d.stride == 1 )
+	{
+	  // x-x is zero for finite values and nan for nan or inf, so
+	  // blocks of finite values are skipped two at a time
+	  const __m128d zero = _mm_setzero_pd();
+	  while( i+2 <= n )
+	    {
+	      const __m128d v = _mm_loadu_pd(d.data+i);
+	      const __m128d finite = _mm_cmpeq_pd(_mm_sub_pd(v, v), zero);
+	      if( _mm_movemask_pd(finite) != 3 )
+		break;
+	      i += 2;
+	    }
+	}
+#endif
+      while( i < n && isFinite(d(i)) )
+	++i;
+
+      out.start.append(runstart);
+      out.len.append(i-runstart);
+    }
+}
+
+void intersectFiniteRuns(const FiniteRuns& a, const FiniteRuns& b,
+			 FiniteRuns& out)
+{
+  out.start.resize(0);
+  out.len.resize(0);
+
+  // standard interval intersection over the sorted runs
+  int ia = 0, ib = 0;
+  while( ia < a.size() && ib < b.size() )
+    {
+      const int aend = a.start[ia] + a.len[ia];
+      const int bend = b.start[ib] + b.len[ib];
+      const int s = qMax(a.start[ia], b.start[ib]);
+      const int e = qMin(aend, bend);
+      if( s < e )
+	{
+	  out.start.append(s);
+	  out.len.append(e-s);
+	}
+      if( aend < bend )
+	++ia;
+      else
+	++ib;
+    }
+}
+
+DatasetHandle::DatasetHandle(PyObject* array)
+  : _array(array), _data(0), _runsvalid(false)
+{
+  // may throw if the object isn't convertible; nothing is kept then
+  _data = new Numpy1DObj(array);
+  Py_INCREF(_array);
+  arrayIdentity(_array, &_rawptr, &_rawdim);
+}
+
+DatasetHandle::~DatasetHandle()
+{
+  delete _data;
+  Py_DECREF(_array);
+  _array = 0;
+}
+
+const Numpy1DObj& DatasetHandle::data()
+{
+  // in-place modifications show up through the zero-copy view, but
+  // an array rebound to a new buffer or resized needs converting again
+  const void* rawptr;
+  int rawdim;
+  arrayIdentity(_array, &rawptr, &rawdim);
+  if( rawptr != _rawptr || rawdim != _rawdim )
+    {
+      Numpy1DObj* fresh = new Numpy1DObj(_array);
+      delete _data;
+      _data = fresh;
+      _rawptr = rawptr;
+      _rawdim = rawdim;
+      _runsvalid = false;
+    }
+  return *_data;
+}
+
+const FiniteRuns& DatasetHandle::finiteRuns()
+{
+  // revalidates the conversion, invalidating stale runs
+  data();
+  if( ! _runsvalid )
+    {
+      computeFiniteRuns(*_data, _runs);
+      _runsvalid = true;
+    }
+  return _runs;
+}
+
 PyObject* doubleArrayToNumpy(const double* d, int len)
 {
   npy_intp dims[1];
@@ -142,3 +337,17 @@ PyObject* doubleArrayToNumpy(const double* d, int len)
 
   return n;
 }
+
+PyObject* doubleArrayToNumpy2D(const double* d, int dimy, int dimx)
+{
+  npy_intp dims[2];
+  dims[0] = dimy;
+  dims[1] = dimx;
+  PyObject* n = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+
+  double* pydata = (double*) ((PyArrayObject*)(n))->data;
+  for(int i = 0; i < dimy*dimx; ++i)
+    pydata[i] = d[i];
+
+  return n;
+}
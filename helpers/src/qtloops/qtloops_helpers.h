@@ -47,6 +47,9 @@ private:
 };
 
 // class for converting numpy array to an array
+// aligned native double arrays are used in place without copying,
+// including strided views; other inputs are converted to a
+// contiguous temporary
 class Numpy1DObj
 {
  public:
@@ -55,12 +58,14 @@ class Numpy1DObj
 
   const double* data;
   int dim;
+  // spacing of elements (in doubles, 1 if contiguous)
+  int stride;
 
   inline double operator()(const int x) const
   {
     if( DEBUG && (x < 0 || x >= dim) )
 	throw "Invalid index in array";
-    return data[x];
+    return data[x*stride];
   }
 
  private:
@@ -68,20 +73,27 @@ class Numpy1DObj
 };
 
 // class for converting a 2D numpy array to an array
+// as for Numpy1DObj, suitable double arrays are used without copying
 class Numpy2DObj
 {
  public:
   Numpy2DObj(PyObject* array);
+  // wrap an existing contiguous row-major buffer of shape
+  // (dimy, dimx) without taking ownership
+  Numpy2DObj(const double* d, int dimy, int dimx);
   ~Numpy2DObj();
 
   const double* data;
   int dims[2];
+  // element spacing (in doubles) for each dimension
+  // strides[0] applies to y, strides[1] to x
+  int strides[2];
 
   inline double operator()(const int x, const int y) const
   {
     if( DEBUG && (x < 0 || x >= dims[0] || y < 0 || y >= dims[1]) )
       throw "Invalid index in array";
-    return data[x+y*dims[1]];
+    return data[x*strides[1]+y*strides[0]];
   }
 
  private:
@@ -109,6 +121,68 @@ class Numpy2DIntObj
   PyObject* _array;
 };
 
+// index of the runs of finite values in an array: start[i] is the
+// first index and len[i] the number of consecutive finite values of
+// the i'th run. NaN-aware loops iterate the runs instead of testing
+// every element
+struct FiniteRuns
+{
+  QVector<int> start;
+  QVector<int> len;
+
+  int size() const { return start.size(); }
+};
+
+// scan an array once for its runs of finite values
+void computeFiniteRuns(const Numpy1DObj& d, FiniteRuns& out);
+
+// compute the spans finite in both a and b
+void intersectFiniteRuns(const FiniteRuns& a, const FiniteRuns& b,
+			 FiniteRuns& out);
+
+// holds a dataset converted once and reused across plotting calls,
+// so interactive redraws don't pay conversion and validation for the
+// same unchanged array on every call
+// the handle revalidates against the numpy array when accessed and
+// converts again if the array's buffer or length changed
+class DatasetHandle
+{
+ public:
+  DatasetHandle(PyObject* array);
+  ~DatasetHandle();
+
+  // number of elements in the dataset
+  int dim() const { return _data->dim; }
+
+  // access converted data, reconverting if stale
+  const Numpy1DObj& data();
+
+  // runs of finite values, computed on first use and kept until the
+  // array is rebound or resized; datasets are replaced rather than
+  // modified in place, so the runs stay in step with the data
+  const FiniteRuns& finiteRuns();
+
+ private:
+  // not copyable
+  DatasetHandle(const DatasetHandle&);
+  DatasetHandle& operator=(const DatasetHandle&);
+
+ private:
+  PyObject* _array;
+  Numpy1DObj* _data;
+
+  // buffer and length of the array at conversion, used to detect
+  // rebinding or resizing
+  const void* _rawptr;
+  int _rawdim;
+
+  FiniteRuns _runs;
+  bool _runsvalid;
+};
+
 PyObject* doubleArrayToNumpy(const double* d, int len);
 
+// build a 2D numpy array of shape (dimy, dimx) from row-major data
+PyObject* doubleArrayToNumpy2D(const double* d, int dimy, int dimx);
+
 #endif
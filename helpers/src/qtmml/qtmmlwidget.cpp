@@ -46,7 +46,10 @@
 
 #include <QtGui/QApplication>
 #include <QtCore/QString>
+#include <QtCore/QCache>
 #include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QXmlStreamReader>
 #include <QtGui/QDesktopWidget>
 #include <QtGui/QPainter>
 #include <QtGui/QPaintEvent>
@@ -139,6 +142,17 @@ struct EntitySpec
 
 typedef QMap<QString, QString> MmlAttributeMap;
 class MmlNode;
+
+// one node of a parsed document, recorded in preorder: each element
+// is followed by the records of its numchildren children
+struct ParsedElement
+{
+    Mml::NodeType type;
+    MmlAttributeMap attr;
+    QString text;	// character data for text nodes
+    int numchildren;
+};
+typedef QList<ParsedElement> ParsedMml;
 } // namespace
 
 class MmlDocument : public Mml
@@ -175,11 +189,15 @@ class MmlDocument : public Mml
 	void _dump(const MmlNode *node, QString &indent) const;
 	bool insertChild(MmlNode *parent, MmlNode *new_node, QString *errorMsg);
 
-	MmlNode *domToMml(const QDomNode &dom_node, bool *ok, QString *errorMsg);
+	MmlNode *streamToMml(QXmlStreamReader &xml, bool *ok, QString *errorMsg,
+				ParsedMml *record);
+	MmlNode *parsedToMml(const ParsedMml &parsed, int &pos, bool *ok,
+				QString *errorMsg);
 	MmlNode *createNode(NodeType type, const MmlAttributeMap &mml_attr,
 				const QString &mml_value, QString *errorMsg);
-	MmlNode *createImplicitMrowNode(const QDomNode &dom_node, bool *ok,
-				    QString *errorMsg);
+	MmlNode *assembleNode(NodeType type, const MmlAttributeMap &mml_attr,
+				QList<MmlNode*> &children, bool *ok,
+				QString *errorMsg);
 
 	void insertOperator(MmlNode *node, const QString &text);
 
@@ -3072,52 +3090,6 @@ void MmlDocument::setFontName(QtMmlWidget::MmlFont type, const QString &name)
     };
 }
 
-Mml::NodeType domToMmlNodeType(const QDomNode &dom_node)
-{
-    Mml::NodeType mml_type = Mml::NoNode;
-
-    switch (dom_node.nodeType()) {
-	case QDomNode::ElementNode: {
-	    QString tag = dom_node.nodeName();
-	    const NodeSpec *spec = mmlFindNodeSpec(tag);
-
-	    // treat urecognised tags as mrow
-	    if (spec == 0)
-		mml_type = Mml::UnknownNode;
-	    else
-		mml_type = spec->type;
-
-	    break;
-	}
-	case QDomNode::TextNode:
-	    mml_type = Mml::TextNode;
-	    break;
-
-	case QDomNode::DocumentNode:
-	    mml_type = Mml::MrowNode;
-	    break;
-
-	case QDomNode::EntityReferenceNode:
-//	    qWarning("EntityReferenceNode: name=\"" + dom_node.nodeName() + "\" value=\"" + dom_node.nodeValue() + "\"");
-	    break;
-
-	case QDomNode::AttributeNode:
-	case QDomNode::CDATASectionNode:
-	case QDomNode::EntityNode:
-	case QDomNode::ProcessingInstructionNode:
-	case QDomNode::CommentNode:
-	case QDomNode::DocumentTypeNode:
-	case QDomNode::DocumentFragmentNode:
-	case QDomNode::NotationNode:
-	case QDomNode::BaseNode:
-	case QDomNode::CharacterDataNode:
-	    break;
-    }
-
-    return mml_type;
-}
-
-
 MmlDocument::MmlDocument()
 {
     m_root_node = 0;
@@ -3172,51 +3144,111 @@ void MmlDocument::_dump(const MmlNode *node, QString &indent) const
     indent.truncate(indent.length() - 2);
 }
 
+// documents often repeat the same expressions many times (e.g. axis
+// labels redrawn at every paint), so successful parses are recorded
+// and reused; the cached form is the pre-layout parse tree, which
+// does not depend on the fonts or base size of the document reusing
+// it, so the source text alone is a sufficient key
+// the cache is shared between documents and may be reached from
+// rendering threads, hence the mutex; records are copied in and out
+// under the lock and the MmlNode tree rebuilt outside it
+static QCache<QString, ParsedMml> g_parse_cache(100);
+static QMutex g_parse_cache_mutex;
+
 bool MmlDocument::setContent(QString text, QString *errorMsg,
 				    int *errorLine, int *errorColumn)
 {
     clear();
 
-    QString prefix = "<?xml version=\"2.0\"?>\n";
-    prefix.append(entityDeclarations());
-
-    uint prefix_lines = 0;
-    for (int i = 0; i < prefix.length(); ++i) {
-	if (prefix.at(i) == '\n')
-	    ++prefix_lines;
+    ParsedMml parsed;
+    bool in_cache = false;
+    {
+	QMutexLocker locker(&g_parse_cache_mutex);
+	ParsedMml *entry = g_parse_cache.object(text);
+	if (entry != 0) {
+	    parsed = *entry;
+	    in_cache = true;
+	}
     }
 
-    QDomDocument dom;
-    if (!dom.setContent(prefix + text, false, errorMsg, errorLine, errorColumn)) {
-	if (errorLine != 0)
-	    *errorLine -= prefix_lines;
-	return false;
+    bool ok = true;
+    MmlNode *root_element = 0;
+
+    if (in_cache) {
+	if (errorLine != 0) *errorLine = -1;
+	if (errorColumn != 0) *errorColumn = -1;
+
+	int pos = 0;
+	root_element = parsedToMml(parsed, pos, &ok, errorMsg);
     }
+    else {
+	QString prefix = "<?xml version=\"1.0\"?>\n";
+	prefix.append(entityDeclarations());
 
-    // we don't have access to line info from now on
-    if (errorLine != 0) *errorLine = -1;
-    if (errorColumn != 0) *errorColumn = -1;
+	uint prefix_lines = 0;
+	for (int i = 0; i < prefix.length(); ++i) {
+	    if (prefix.at(i) == '\n')
+		++prefix_lines;
+	}
+
+	// the MmlNode tree is built directly from the stream reader in
+	// a single pass, with no intermediate DOM: documents commonly
+	// contain thousands of small expressions, and allocating a DOM
+	// node and an MmlNode for every element dominated load time
+	QXmlStreamReader xml(prefix + text);
+
+	while (!xml.atEnd()) {
+	    QXmlStreamReader::TokenType token = xml.readNext();
+	    if (token == QXmlStreamReader::StartElement) {
+		root_element = streamToMml(xml, &ok, errorMsg, &parsed);
+		break;
+	    }
+	    // the prolog and DTD tokens before the root element are skipped
+	}
+
+	if (xml.hasError()) {
+	    delete root_element;
+	    if (errorMsg != 0)
+		*errorMsg = xml.errorString();
+	    if (errorLine != 0)
+		*errorLine = int(xml.lineNumber()) - prefix_lines;
+	    if (errorColumn != 0)
+		*errorColumn = int(xml.columnNumber());
+	    return false;
+	}
+
+	// conversion errors carry no position
+	if (errorLine != 0) *errorLine = -1;
+	if (errorColumn != 0) *errorColumn = -1;
+
+	// only successful parses are worth keeping
+	if (ok && root_element != 0) {
+	    QMutexLocker locker(&g_parse_cache_mutex);
+	    g_parse_cache.insert(text, new ParsedMml(parsed));
+	}
+    }
 
-    bool ok;
-    MmlNode *root_node = domToMml(dom, &ok, errorMsg);
     if (!ok)
 	return false;
 
-    if (root_node == 0) {
+    if (root_element == 0) {
 	if (errorMsg != 0)
 	    *errorMsg = "empty document";
 	return false;
     }
 
+    // the document is wrapped in an mrow, as the DOM-based parser did
+    // for the document node
+    QList<MmlNode*> root_children;
+    root_children.append(root_element);
+    MmlNode *root_node = assembleNode(MrowNode, MmlAttributeMap(),
+					root_children, &ok, errorMsg);
+    if (!ok)
+	return false;
+
     insertChild(0, root_node, 0);
     layout();
 
-/*    QFile of("/tmp/dump.xml");
-    of.open(IO_WriteOnly);
-    QTextStream os(&of);
-    os.setEncoding(QTextStream::UnicodeUTF8);
-    os << dom.toString(); */
-
     return true;
 }
 
@@ -3377,43 +3409,153 @@ void MmlDocument::insertOperator(MmlNode *node, const QString &text)
     Q_ASSERT( ok );
 }
 
-MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *errorMsg)
+// called with the reader positioned on a start element; consumes
+// everything up to and including the matching end element, building
+// the node and its children as the stream is read
+MmlNode *MmlDocument::streamToMml(QXmlStreamReader &xml, bool *ok,
+				    QString *errorMsg, ParsedMml *record)
 {
-    // create the node
+    Q_ASSERT(ok != 0);
+
+    QString tag = xml.name().toString();
+    const NodeSpec *tag_spec = mmlFindNodeSpec(tag);
+
+    // treat urecognised tags as mrow
+    NodeType mml_type = (tag_spec == 0) ? UnknownNode : tag_spec->type;
+
+    MmlAttributeMap mml_attr;
+    QXmlStreamAttributes xml_attr = xml.attributes();
+    for (int i = 0; i < xml_attr.count(); ++i)
+	mml_attr[xml_attr[i].name().toString()] = xml_attr[i].value().toString();
+
+    // record this element for the parse cache; the child count is
+    // filled in once the children have been read
+    int record_idx = -1;
+    if (record != 0) {
+	record_idx = record->count();
+	ParsedElement el;
+	el.type = mml_type;
+	el.attr = mml_attr;
+	el.numchildren = 0;
+	record->append(el);
+    }
+
+    // collect the children; adjacent character chunks (as produced
+    // around resolved entities) merge into a single text node
+    QList<MmlNode*> children;
+    QString char_data;
+    bool in_char_data = false;
+
+    for (;;) {
+	QXmlStreamReader::TokenType token = xml.readNext();
+
+	if (token != QXmlStreamReader::Characters && in_char_data) {
+	    if (!char_data.simplified().isEmpty()) {
+		MmlNode *text_node = createNode(TextNode, MmlAttributeMap(),
+						char_data, errorMsg);
+		if (text_node == 0) {
+		    qDeleteAll(children);
+		    *ok = false;
+		    return 0;
+		}
+		children.append(text_node);
+		if (record != 0) {
+		    ParsedElement el;
+		    el.type = TextNode;
+		    el.text = char_data;
+		    el.numchildren = 0;
+		    record->append(el);
+		}
+	    }
+	    char_data.clear();
+	    in_char_data = false;
+	}
 
+	if (token == QXmlStreamReader::StartElement) {
+	    MmlNode *mml_child = streamToMml(xml, ok, errorMsg, record);
+	    if (!*ok) {
+		qDeleteAll(children);
+		return 0;
+	    }
+	    if (mml_child != 0)
+		children.append(mml_child);
+	}
+	else if (token == QXmlStreamReader::Characters) {
+	    char_data += xml.text().toString();
+	    in_char_data = true;
+	}
+	else if (token == QXmlStreamReader::EndElement) {
+	    break;
+	}
+	else if (token == QXmlStreamReader::Invalid
+		 || token == QXmlStreamReader::EndDocument) {
+	    // the error string is taken from the reader by the caller
+	    qDeleteAll(children);
+	    *ok = false;
+	    return 0;
+	}
+	// comments and processing instructions are skipped
+    }
+
+    if (record != 0)
+	(*record)[record_idx].numchildren = children.count();
+
+    return assembleNode(mml_type, mml_attr, children, ok, errorMsg);
+}
+
+// rebuild a node and its children from a record made by streamToMml,
+// advancing pos past the subtree read
+MmlNode *MmlDocument::parsedToMml(const ParsedMml &parsed, int &pos, bool *ok,
+				    QString *errorMsg)
+{
     Q_ASSERT(ok != 0);
+    Q_ASSERT(pos < parsed.count());
 
-    NodeType mml_type = domToMmlNodeType(dom_node);
+    const ParsedElement &el = parsed.at(pos);
+    ++pos;
 
-    if (mml_type == NoNode) {
-	*ok = true;
-	return 0;
+    if (el.type == TextNode) {
+	MmlNode *text_node = createNode(TextNode, MmlAttributeMap(),
+					el.text, errorMsg);
+	if (text_node == 0)
+	    *ok = false;
+	return text_node;
     }
 
-    QDomNamedNodeMap dom_attr = dom_node.attributes();
-    MmlAttributeMap mml_attr;
-    for (unsigned i = 0; i < dom_attr.length(); ++i) {
-	QDomNode attr_node = dom_attr.item(i);
-	Q_ASSERT(!attr_node.nodeName().isNull());
-	Q_ASSERT(!attr_node.nodeValue().isNull());
-	mml_attr[attr_node.nodeName()] = attr_node.nodeValue();
+    QList<MmlNode*> children;
+    for (int i = 0; i < el.numchildren; ++i) {
+	MmlNode *mml_child = parsedToMml(parsed, pos, ok, errorMsg);
+	if (!*ok) {
+	    qDeleteAll(children);
+	    return 0;
+	}
+	if (mml_child != 0)
+	    children.append(mml_child);
     }
 
-    QString mml_value;
-    if (mml_type == TextNode)
-	mml_value = dom_node.nodeValue();
-    MmlNode *mml_node = createNode(mml_type, mml_attr, mml_value, errorMsg);
+    return assembleNode(el.type, el.attr, children, ok, errorMsg);
+}
+
+// build a node from its already-converted children according to the
+// child_spec; takes ownership of the children, which are deleted on
+// failure
+MmlNode *MmlDocument::assembleNode(NodeType mml_type,
+					const MmlAttributeMap &mml_attr,
+					QList<MmlNode*> &children, bool *ok,
+					QString *errorMsg)
+{
+    Q_ASSERT(ok != 0);
+
+    MmlNode *mml_node = createNode(mml_type, mml_attr, QString::null, errorMsg);
     if (mml_node == 0) {
+	qDeleteAll(children);
+	children.clear();
 	*ok = false;
 	return 0;
     }
 
-    // create the node's children according to the child_spec
-
     const NodeSpec *spec = mmlFindNodeSpec(mml_type);
-    QDomNodeList dom_child_list = dom_node.childNodes();
-    int child_cnt = dom_child_list.count();
-    MmlNode *mml_child = 0;
+    int child_cnt = children.count();
 
     QString separator_list;
     if (mml_type == MfencedNode)
@@ -3421,20 +3563,30 @@ MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *erro
 
     switch (spec->child_spec) {
 	case NodeSpec::ChildIgnore:
+	    qDeleteAll(children);
+	    children.clear();
 	    break;
 
 	case NodeSpec::ImplicitMrow:
 
 	    if (child_cnt > 0) {
-		mml_child = createImplicitMrowNode(dom_node, ok, errorMsg);
-		if (!*ok) {
-		    delete mml_node;
-		    return 0;
+		MmlNode *mml_child;
+		if (child_cnt == 1)
+		    mml_child = children.takeFirst();
+		else {
+		    mml_child = assembleNode(MrowNode, MmlAttributeMap(),
+						children, ok, errorMsg);
+		    if (!*ok) {
+			delete mml_node;
+			return 0;
+		    }
 		}
 
 		if (!insertChild(mml_node, mml_child, errorMsg)) {
 		    delete mml_node;
 		    delete mml_child;
+		    qDeleteAll(children);
+		    children.clear();
 		    *ok = false;
 		    return 0;
 		}
@@ -3453,24 +3605,20 @@ MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *erro
 			+ " arguments, got "
 			+ QString::number(child_cnt);
 		delete mml_node;
+		qDeleteAll(children);
+		children.clear();
 		*ok = false;
 		return 0;
-	}
+	    }
 
-	// ...and continue just as in ChildAny
+	    // ...and continue just as in ChildAny
 
 	case NodeSpec::ChildAny:
 	    if (mml_type == MfencedNode)
 		insertOperator(mml_node, mml_node->explicitAttribute("open", "("));
 
 	    for (int i = 0; i < child_cnt; ++i) {
-		QDomNode dom_child = dom_child_list.item(i);
-
-		MmlNode *mml_child = domToMml(dom_child, ok, errorMsg);
-		if (!*ok) {
-		    delete mml_node;
-		    return 0;
-		}
+		MmlNode *mml_child = children.takeFirst();
 
 		if (mml_type == MtableNode && mml_child->nodeType() != MtrNode) {
 		    MmlNode *mtr_node = createNode(MtrNode, MmlAttributeMap(), QString::null, 0);
@@ -3478,6 +3626,7 @@ MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *erro
 		    if (!insertChild(mtr_node, mml_child, errorMsg)) {
 			delete mml_node;
 			delete mml_child;
+			qDeleteAll(children);
 			*ok = false;
 			return 0;
 		    }
@@ -3488,6 +3637,7 @@ MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *erro
 		    if (!insertChild(mtd_node, mml_child, errorMsg)) {
 			delete mml_node;
 			delete mml_child;
+			qDeleteAll(children);
 			*ok = false;
 			return 0;
 		    }
@@ -3496,6 +3646,7 @@ MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *erro
 		    if (!insertChild(mml_node, mml_child, errorMsg)) {
 			delete mml_node;
 			delete mml_child;
+			qDeleteAll(children);
 			*ok = false;
 			return 0;
 		    }
@@ -3521,44 +3672,6 @@ MmlNode *MmlDocument::domToMml(const QDomNode &dom_node, bool *ok, QString *erro
     return mml_node;
 }
 
-MmlNode *MmlDocument::createImplicitMrowNode(const QDomNode &dom_node, bool *ok,
-						QString *errorMsg)
-{
-    QDomNodeList dom_child_list = dom_node.childNodes();
-    int child_cnt = dom_child_list.count();
-
-    if (child_cnt == 0) {
-	*ok = true;
-	return 0;
-    }
-
-    if (child_cnt == 1)
-	return domToMml(dom_child_list.item(0), ok, errorMsg);
-
-    MmlNode *mml_node = createNode(MrowNode, MmlAttributeMap(),
-				    QString::null, errorMsg);
-    Q_ASSERT(mml_node != 0); // there is no reason in heaven or hell for this to fail
-
-    for (int i = 0; i < child_cnt; ++i) {
-	QDomNode dom_child = dom_child_list.item(i);
-
-	MmlNode *mml_child = domToMml(dom_child, ok, errorMsg);
-	if (!*ok) {
-	    delete mml_node;
-	    return 0;
-	}
-
-	if (!insertChild(mml_node, mml_child, errorMsg)) {
-	    delete mml_node;
-	    delete mml_child;
-	    *ok = false;
-	    return 0;
-	}
-    }
-
-    return mml_node;
-}
-
 void MmlDocument::paint(QPainter *p, const QPoint &pos) const
 {
     if (m_root_node == 0)
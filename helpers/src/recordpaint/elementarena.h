@@ -0,0 +1,78 @@
+//    Copyright (C) 2012 Jeremy S. Sanders
+//    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef ELEMENTARENA_H
+#define ELEMENTARENA_H
+
+#include <cstddef>
+#include <QVector>
+
+// Bump allocator for paint elements. A recorded page makes many
+// thousands of small allocations which are all freed together, so
+// elements are packed into large blocks and the whole lot released
+// when the arena is destroyed.
+class ElementArena
+{
+public:
+  ElementArena(size_t blocksize = 65536)
+    : _blocksize(blocksize), _used(0), _current(0)
+  {
+  }
+
+  ~ElementArena()
+  {
+    foreach(char* block, _blocks)
+      delete[] block;
+  }
+
+  // return size bytes of storage, only freed when the arena is
+  // destroyed
+  void* allocate(size_t size)
+  {
+    // keep elements naturally aligned
+    size = (size + 15) & ~size_t(15);
+
+    if( size > _blocksize )
+      {
+	// oversized allocations get a dedicated block
+	char* block = new char[size];
+	_blocks.push_back(block);
+	return block;
+      }
+
+    if( _current == 0 || _used + size > _blocksize )
+      {
+	// start a new block
+	_current = new char[_blocksize];
+	_blocks.push_back(_current);
+	_used = 0;
+      }
+
+    char* retn = _current + _used;
+    _used += size;
+    return retn;
+  }
+
+private:
+  size_t _blocksize;
+  size_t _used;
+  char* _current;
+  QVector<char*> _blocks;
+};
+
+#endif
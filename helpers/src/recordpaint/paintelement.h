@@ -19,6 +19,11 @@
 #ifndef PAINTELEMENT_H
 #define PAINTELEMENT_H
 
+#include "elementarena.h"
+
+#include <QRectF>
+
+class QDataStream;
 class QPainter;
 class QTransform;
 
@@ -26,6 +31,34 @@ class PaintElement {
 public:
   virtual ~PaintElement() {};
   virtual void paint(QPainter& painter, const QTransform& origtransform) = 0;
+
+  // write element type and payload to the stream
+  virtual void save(QDataStream& stream) const = 0;
+
+  // bounding rectangle of the drawn primitive in logical coordinates
+  // a null rectangle means unknown; such elements (including state
+  // changes) are always replayed
+  virtual QRectF boundingRect() const { return QRectF(); }
+
+  // whether paint may run outside the GUI thread; elements drawing a
+  // QPixmap must not, as pixmaps are tied to the GUI thread on
+  // platforms with a native graphics system (Qt 4 on X11)
+  virtual bool threadSafe() const { return true; }
+
+  // elements are allocated within the device's arena
+  void* operator new(size_t size, ElementArena& arena)
+  {
+    return arena.allocate(size);
+  }
+  // matching form used if a constructor throws
+  void operator delete(void*, ElementArena&) {}
+  // storage is reclaimed by the arena, not per element
+  void operator delete(void*) {}
 };
 
+// recreate an element previously written by PaintElement::save,
+// allocating it from the arena given
+// returns 0 if the stream holds an unknown element type
+PaintElement* createPaintElement(QDataStream& stream, ElementArena& arena);
+
 #endif
@@ -17,12 +17,22 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include <QtAlgorithms>
+#include <QDataStream>
+#include <QImage>
+#include <QPainter>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
 #include <limits>
 #include "recordpaintdevice.h"
 #include "recordpaintengine.h"
 
 #define INCH_MM 25.4
 
+// identify serialized recordings ("VZRP") and their format version
+#define RECORD_MAGIC 0x565a5250
+#define RECORD_VERSION 1
+
 RecordPaintDevice::RecordPaintDevice(int width, int height,
 				     int dpix, int dpiy)
   :_width(width), _height(height), _dpix(dpix), _dpiy(dpiy),
@@ -33,7 +43,11 @@ RecordPaintDevice::RecordPaintDevice(int width, int height,
 RecordPaintDevice::~RecordPaintDevice()
 {
   delete _engine;
-  qDeleteAll(_elements);
+
+  // elements live in the arena, so run destructors here and let the
+  // arena release the storage in bulk
+  foreach(PaintElement* el, _elements)
+    el->~PaintElement();
 }
 
 QPaintEngine* RecordPaintDevice::paintEngine() const
@@ -67,11 +81,188 @@ int RecordPaintDevice::metric(QPaintDevice::PaintDeviceMetric metric) const
   }
 }
 
+void RecordPaintDevice::save(QDataStream& stream) const
+{
+  // pin the qt serialization format so recordings are portable
+  // between qt versions
+  stream.setVersion(QDataStream::Qt_4_4);
+
+  stream << quint32(RECORD_MAGIC) << quint16(RECORD_VERSION)
+	 << qint32(_width) << qint32(_height)
+	 << qint32(_dpix) << qint32(_dpiy);
+
+  stream << quint32(_elements.size());
+  foreach(PaintElement* el, _elements)
+    el->save(stream);
+}
+
+bool RecordPaintDevice::load(QDataStream& stream)
+{
+  stream.setVersion(QDataStream::Qt_4_4);
+
+  quint32 magic;
+  quint16 version;
+  stream >> magic >> version;
+  if( magic != RECORD_MAGIC || version != RECORD_VERSION )
+    return false;
+
+  qint32 width, height, dpix, dpiy;
+  stream >> width >> height >> dpix >> dpiy;
+  _width = width;
+  _height = height;
+  _dpix = dpix;
+  _dpiy = dpiy;
+
+  quint32 numelements;
+  stream >> numelements;
+  for(quint32 i = 0; i < numelements; ++i)
+    {
+      PaintElement* el = createPaintElement(stream, _arena);
+      if( el == 0 || stream.status() != QDataStream::Ok )
+	return false;
+      addElement(el);
+    }
+  return true;
+}
+
 void RecordPaintDevice::play(QPainter& painter)
 {
   QTransform origtransform(painter.worldTransform());
-  foreach(PaintElement* el, _elements)
+  for(ElementIterator i = elementsBegin(); i != elementsEnd(); ++i)
+    {
+      (*i)->paint(painter, origtransform);
+    }
+}
+
+void RecordPaintDevice::playDamaged(QPainter& painter, const QRectF& damage)
+{
+  const QTransform origtransform(painter.worldTransform());
+  const QTransform originv(origtransform.inverted());
+
+  for(ElementIterator i = elementsBegin(); i != elementsEnd(); ++i)
+    {
+      const QRectF bounds = (*i)->boundingRect();
+      if( bounds.isNull() )
+	{
+	  // state changes and elements without known bounds must
+	  // replay so later elements see the right painter state
+	  (*i)->paint(painter, origtransform);
+	  continue;
+	}
+
+      // transforms applied since recording started map element
+      // bounds into recorded coordinates to compare with the damage;
+      // grow by the pen width (plus a little, so zero-area bounds
+      // from horizontal or vertical lines still intersect)
+      const QTransform rel = painter.worldTransform() * originv;
+      const qreal lw = painter.pen().widthF() + 1.;
+      if( rel.mapRect(bounds).adjusted(-lw, -lw, lw, lw)
+	  .intersects(damage) )
+	(*i)->paint(painter, origtransform);
+    }
+}
+
+namespace
+{
+  // replay a horizontal band of a recording into its own image
+  // (separate painters cannot share one QImage, so bands are
+  // composited afterwards)
+  class RenderBandTask : public QRunnable
+  {
+  public:
+    RenderBandTask(const RecordPaintDevice* device, double sx, double sy,
+		   int width, int ystart, int yend)
+      : _device(device), _sx(sx), _sy(sy),
+	_image(width, yend-ystart, QImage::Format_ARGB32_Premultiplied),
+	_ystart(ystart)
     {
-      el->paint(painter, origtransform);
+      setAutoDelete(false);
+    }
+
+    void run()
+    {
+      _image.fill(0);
+      QPainter painter(&_image);
+      painter.setRenderHint(QPainter::Antialiasing);
+      painter.setRenderHint(QPainter::TextAntialiasing);
+
+      // map recorded coordinates into this band
+      painter.translate(0, -_ystart);
+      painter.scale(_sx, _sy);
+
+      const QTransform origtransform(painter.worldTransform());
+      for(RecordPaintDevice::ElementIterator i = _device->elementsBegin();
+	  i != _device->elementsEnd(); ++i)
+	(*i)->paint(painter, origtransform);
+      painter.end();
     }
+
+    const QImage& image() const { return _image; }
+    int ystart() const { return _ystart; }
+
+  private:
+    const RecordPaintDevice* _device;
+    double _sx, _sy;
+    QImage _image;
+    int _ystart;
+  };
+
+  // do not make bands shorter than this
+  const int MINBANDHEIGHT = 64;
+}
+
+QImage RecordPaintDevice::renderTiled(int pixwidth, int pixheight) const
+{
+  if( pixwidth <= 0 || pixheight <= 0 )
+    return QImage();
+
+  // scaling from recorded coordinates to output pixels
+  const double sx = pixwidth * 1. / _width;
+  const double sy = pixheight * 1. / _height;
+
+  // recordings containing pixmap draws must replay on this thread
+  bool allthreadsafe = true;
+  for(ElementIterator i = elementsBegin(); i != elementsEnd(); ++i)
+    if( ! (*i)->threadSafe() )
+      {
+	allthreadsafe = false;
+	break;
+      }
+
+  const int numbands = allthreadsafe ?
+    qBound(1, QThread::idealThreadCount(), pixheight / MINBANDHEIGHT) : 1;
+  if( numbands < 2 )
+    {
+      // not worth starting threads
+      RenderBandTask task(this, sx, sy, pixwidth, 0, pixheight);
+      task.run();
+      return task.image();
+    }
+
+  const int bandheight = pixheight / numbands + (pixheight % numbands != 0);
+
+  QThreadPool pool;
+  QVector<RenderBandTask*> tasks;
+  for(int ystart = 0; ystart < pixheight; ystart += bandheight)
+    {
+      RenderBandTask* task =
+	new RenderBandTask(this, sx, sy, pixwidth, ystart,
+			   qMin(ystart+bandheight, pixheight));
+      tasks.append(task);
+      pool.start(task);
+    }
+  pool.waitForDone();
+
+  // composite the bands into the output image
+  QImage out(pixwidth, pixheight, QImage::Format_ARGB32_Premultiplied);
+  out.fill(0);
+  QPainter painter(&out);
+  for(int i = 0; i < tasks.size(); ++i)
+    {
+      painter.drawImage(0, tasks[i]->ystart(), tasks[i]->image());
+      delete tasks[i];
+    }
+  painter.end();
+
+  return out;
 }
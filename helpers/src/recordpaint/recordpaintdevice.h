@@ -24,6 +24,9 @@
 #include "paintelement.h"
 #include "recordpaintengine.h"
 
+class QDataStream;
+class QImage;
+
 class RecordPaintDevice : public QPaintDevice
 {
 public:
@@ -31,13 +34,33 @@ public:
   ~RecordPaintDevice();
   QPaintEngine* paintEngine() const;
 
-  // play back all 
+  // play back all
   void play(QPainter& painter);
 
+  // replay the recording into an image of the size given, splitting
+  // the image into horizontal bands rendered on separate threads
+  QImage renderTiled(int pixwidth, int pixheight) const;
+
+  // play back only elements whose bounds intersect the damaged
+  // rectangle (in recorded coordinates); state changes and elements
+  // without bounds are always replayed to keep painter state correct
+  void playDamaged(QPainter& painter, const QRectF& damage);
+
+  // write recorded commands to the stream in binary form
+  void save(QDataStream& stream) const;
+  // append commands previously written by save
+  // returns false if the stream is not a valid recording
+  bool load(QDataStream& stream);
+
   int metric(QPaintDevice::PaintDeviceMetric metric) const;
 
   int drawItemCount() const { return _engine->drawItemCount(); }
 
+  // iterate over recorded elements for replay
+  typedef QVector<PaintElement*>::const_iterator ElementIterator;
+  ElementIterator elementsBegin() const { return _elements.constBegin(); }
+  ElementIterator elementsEnd() const { return _elements.constEnd(); }
+
 public:
   friend class RecordPaintEngine;
 
@@ -48,9 +71,13 @@ private:
     _elements.push_back(el);
   }
 
+  // arena holding the storage for the elements
+  ElementArena& arena() { return _arena; }
+
 private:
   int _width, _height, _dpix, _dpiy;
   RecordPaintEngine* _engine;
+  ElementArena _arena;
   QVector<PaintElement*> _elements;
 };
 
@@ -22,6 +22,7 @@
 #include <QLineF>
 #include <QVector>
 #include <QPaintEngine>
+#include <QDataStream>
 
 #include "paintelement.h"
 #include "recordpaintengine.h"
@@ -29,27 +30,68 @@
 
 namespace {
 
+  // identifiers written to serialization streams for each element
+  // new types must be added at the end to keep streams compatible
+  enum ElementType {
+    InvalidType = 0,
+    EllipseType, EllipseFType,
+    ImageType,
+    LineType, LineFType,
+    PathType,
+    PixmapType,
+    PointType, PointFType,
+    PolygonType, PolygonFType,
+    RectType, RectFType,
+    TextType,
+    TiledPixmapType,
+    BackgroundBrushType, BackgroundModeType,
+    BrushType, BrushOriginType,
+    ClipRegionType, ClipPathType,
+    CompositionType,
+    FontType,
+    TransformType,
+    ClipEnabledType,
+    PenType,
+    HintsType
+  };
+
   //////////////////////////////////////////////////////////////
   // Drawing Elements
-  // these are defined for each type of painting 
+  // these are defined for each type of painting
   // the QPaintEngine does
+  // each element also knows how to save itself to a QDataStream
+  // and recreate itself from one (see createPaintElement below)
 
   // draw an ellipse (QRect and QRectF)
-  template <class T>
+  template <class T, ElementType TYPE>
   class ellipseElement : public PaintElement {
   public:
     ellipseElement(const T &rect) : _ellipse(rect) {}
+    ellipseElement(QDataStream& stream)
+    {
+      stream >> _ellipse;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawEllipse(_ellipse);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TYPE) << _ellipse;
+    }
+
+    QRectF boundingRect() const
+    {
+      return QRectF(_ellipse);
+    }
+
   private:
     T _ellipse;
   };
-  typedef ellipseElement<QRect> EllipseElement;
-  typedef ellipseElement<QRectF> EllipseFElement;
+  typedef ellipseElement<QRect, EllipseType> EllipseElement;
+  typedef ellipseElement<QRectF, EllipseFType> EllipseFElement;
 
   // draw QImage
   class ImageElement : public PaintElement {
@@ -58,12 +100,29 @@ namespace {
 		 const QRectF& sr, Qt::ImageConversionFlags flags)
       : _image(image), _rect(rect), _sr(sr), _flags(flags)
     {}
+    ImageElement(QDataStream& stream)
+    {
+      qint32 flags;
+      stream >> _image >> _rect >> _sr >> flags;
+      _flags = Qt::ImageConversionFlags(flags);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawImage(_rect, _image, _sr, _flags);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(ImageType) << _image << _rect << _sr
+	     << qint32(_flags);
+    }
+
+    QRectF boundingRect() const
+    {
+      return _rect.normalized();
+    }
+
   private:
     QImage _image;
     QRectF _rect, _sr;
@@ -72,7 +131,7 @@ namespace {
 
   // draw lines
   // this is for painting QLine and QLineF
-  template <class T>
+  template <class T, ElementType TYPE>
   class lineElement : public PaintElement {
   public:
     lineElement(const T *lines, int linecount)
@@ -80,30 +139,62 @@ namespace {
       for(int i = 0; i < linecount; i++)
 	_lines << lines[i];
     }
+    lineElement(QDataStream& stream)
+    {
+      stream >> _lines;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawLines(_lines);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TYPE) << _lines;
+    }
+
+    QRectF boundingRect() const
+    {
+      QRectF r;
+      for(int i = 0; i < _lines.size(); ++i)
+	r |= QRectF( QPointF(_lines[i].x1(), _lines[i].y1()),
+		     QPointF(_lines[i].x2(), _lines[i].y2()) ).normalized();
+      return r;
+    }
+
   private:
     QVector<T> _lines;
   };
   // specific Line and LineF variants
-  typedef lineElement<QLine> LineElement;
-  typedef lineElement<QLineF> LineFElement;
+  typedef lineElement<QLine, LineType> LineElement;
+  typedef lineElement<QLineF, LineFType> LineFElement;
 
   // draw QPainterPath
   class PathElement : public PaintElement {
   public:
     PathElement(const QPainterPath& path)
       : _path(path) {}
+    PathElement(QDataStream& stream)
+    {
+      stream >> _path;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawPath(_path);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(PathType) << _path;
+    }
+
+    QRectF boundingRect() const
+    {
+      return _path.boundingRect();
+    }
+
   private:
     QPainterPath _path;
   };
@@ -114,12 +205,29 @@ namespace {
     PixmapElement(const QRectF& r, const QPixmap& pm,
 		  const QRectF& sr) :
       _r(r), _pm(pm), _sr(sr) {}
+    PixmapElement(QDataStream& stream)
+    {
+      stream >> _r >> _pm >> _sr;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawPixmap(_r, _pm, _sr);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(PixmapType) << _r << _pm << _sr;
+    }
+
+    QRectF boundingRect() const
+    {
+      return _r.normalized();
+    }
+
+    // QPixmap cannot be drawn from worker threads
+    bool threadSafe() const { return false; }
+
   private:
     QRectF _r;
     QPixmap _pm;
@@ -127,7 +235,7 @@ namespace {
   };
 
   // draw points (QPoint and QPointF)
-  template <class T, class V>
+  template <class T, class V, ElementType TYPE>
   class pointElement : public PaintElement {
   public:
     pointElement(const T* points, int pointcount)
@@ -135,20 +243,34 @@ namespace {
       for(int i=0; i<pointcount; ++i)
 	_pts << points[i];
     }
+    pointElement(QDataStream& stream)
+    {
+      stream >> _pts;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawPoints(_pts);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TYPE) << _pts;
+    }
+
+    QRectF boundingRect() const
+    {
+      return QRectF(_pts.boundingRect());
+    }
+
   private:
     V _pts;
   };
-  typedef pointElement<QPoint, QPolygon> PointElement;
-  typedef pointElement<QPointF, QPolygonF> PointFElement;
+  typedef pointElement<QPoint, QPolygon, PointType> PointElement;
+  typedef pointElement<QPointF, QPolygonF, PointFType> PointFElement;
 
   // for QPolygon and QPolygonF
-  template <class T, class V>
+  template <class T, class V, ElementType TYPE>
   class polyElement: public PaintElement {
   public:
     polyElement(const T* points, int pointcount,
@@ -158,6 +280,12 @@ namespace {
       for(int i=0; i<pointcount; ++i)
 	_pts << points[i];
     }
+    polyElement(QDataStream& stream)
+    {
+      qint32 mode;
+      stream >> mode >> _pts;
+      _mode = QPaintEngine::PolygonDrawMode(mode);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
@@ -178,15 +306,25 @@ namespace {
 	}
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TYPE) << qint32(_mode) << _pts;
+    }
+
+    QRectF boundingRect() const
+    {
+      return QRectF(_pts.boundingRect());
+    }
+
   private:
     QPaintEngine::PolygonDrawMode _mode;
     V _pts;
   };
-  typedef polyElement<QPoint,QPolygon> PolygonElement;
-  typedef polyElement<QPointF,QPolygonF> PolygonFElement;
+  typedef polyElement<QPoint,QPolygon,PolygonType> PolygonElement;
+  typedef polyElement<QPointF,QPolygonF,PolygonFType> PolygonFElement;
 
   // for QRect and QRectF
-  template <class T>
+  template <class T, ElementType TYPE>
   class rectElement : public PaintElement {
   public:
     rectElement(const T* rects, int rectcount)
@@ -194,17 +332,34 @@ namespace {
       for(int i=0; i<rectcount; i++)
 	_rects << rects[i];
     }
+    rectElement(QDataStream& stream)
+    {
+      stream >> _rects;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawRects(_rects);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TYPE) << _rects;
+    }
+
+    QRectF boundingRect() const
+    {
+      QRectF r;
+      for(int i = 0; i < _rects.size(); ++i)
+	r |= QRectF(_rects[i]).normalized();
+      return r;
+    }
+
   private:
     QVector<T> _rects;
   };
-  typedef rectElement<QRect> RectElement;
-  typedef rectElement<QRectF> RectFElement;
+  typedef rectElement<QRect, RectType> RectElement;
+  typedef rectElement<QRectF, RectFType> RectFElement;
 
   // draw Text
   class TextElement : public PaintElement {
@@ -212,12 +367,24 @@ namespace {
     TextElement(const QPointF& pt, const QTextItem& txt)
       : _pt(pt), _text(txt.text())
     {}
+    TextElement(QDataStream& stream)
+    {
+      stream >> _pt >> _text;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawText(_pt, _text);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TextType) << _pt << _text;
+    }
+
+    // no boundingRect: the text extent depends on font metrics only
+    // known at replay time, so text is always replayed
+
   private:
     QPointF _pt;
     QString _text;
@@ -229,12 +396,29 @@ namespace {
 		       const QPointF& pt)
       : _rect(rect), _pixmap(pixmap), _pt(pt)
     {}
+    TiledPixmapElement(QDataStream& stream)
+    {
+      stream >> _rect >> _pixmap >> _pt;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.drawTiledPixmap(_rect, _pixmap, _pt);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TiledPixmapType) << _rect << _pixmap << _pt;
+    }
+
+    QRectF boundingRect() const
+    {
+      return _rect.normalized();
+    }
+
+    // QPixmap cannot be drawn from worker threads
+    bool threadSafe() const { return false; }
+
   private:
     QRectF _rect;
     QPixmap _pixmap;
@@ -251,12 +435,21 @@ namespace {
     BackgroundBrushElement(const QBrush& brush)
       : _brush(brush)
     {}
+    BackgroundBrushElement(QDataStream& stream)
+    {
+      stream >> _brush;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setBackground(_brush);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(BackgroundBrushType) << _brush;
+    }
+
   private:
     QBrush _brush;
   };
@@ -266,12 +459,23 @@ namespace {
     BackgroundModeElement(Qt::BGMode mode)
       : _mode(mode)
     {}
+    BackgroundModeElement(QDataStream& stream)
+    {
+      qint32 mode;
+      stream >> mode;
+      _mode = Qt::BGMode(mode);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setBackgroundMode(_mode);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(BackgroundModeType) << qint32(_mode);
+    }
+
   private:
     Qt::BGMode _mode;
   };
@@ -281,12 +485,21 @@ namespace {
     BrushElement(const QBrush& brush)
       : _brush(brush)
     {}
+    BrushElement(QDataStream& stream)
+    {
+      stream >> _brush;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setBrush(_brush);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(BrushType) << _brush;
+    }
+
   private:
     QBrush _brush;
   };
@@ -296,12 +509,21 @@ namespace {
     BrushOriginElement(const QPointF& origin)
       : _origin(origin)
     {}
+    BrushOriginElement(QDataStream& stream)
+    {
+      stream >> _origin;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setBrushOrigin(_origin);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(BrushOriginType) << _origin;
+    }
+
   private:
     QPointF _origin;
   };
@@ -312,12 +534,23 @@ namespace {
 		      const QRegion& region)
       : _op(op), _region(region)
     {}
+    ClipRegionElement(QDataStream& stream)
+    {
+      qint32 op;
+      stream >> op >> _region;
+      _op = Qt::ClipOperation(op);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setClipRegion(_region, _op);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(ClipRegionType) << qint32(_op) << _region;
+    }
+
   private:
     Qt::ClipOperation _op;
     QRegion _region;
@@ -329,12 +562,23 @@ namespace {
 		    const QPainterPath& region)
       : _op(op), _region(region)
     {}
+    ClipPathElement(QDataStream& stream)
+    {
+      qint32 op;
+      stream >> op >> _region;
+      _op = Qt::ClipOperation(op);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setClipPath(_region, _op);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(ClipPathType) << qint32(_op) << _region;
+    }
+
   private:
     Qt::ClipOperation _op;
     QPainterPath _region;
@@ -345,12 +589,23 @@ namespace {
     CompositionElement(QPainter::CompositionMode mode)
       : _mode(mode)
     {}
+    CompositionElement(QDataStream& stream)
+    {
+      qint32 mode;
+      stream >> mode;
+      _mode = QPainter::CompositionMode(mode);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setCompositionMode(_mode);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(CompositionType) << qint32(_mode);
+    }
+
   private:
     QPainter::CompositionMode _mode;
   };
@@ -360,6 +615,12 @@ namespace {
     FontElement(const QFont& font, int dpi)
       : _dpi(dpi), _font(font)
     {}
+    FontElement(QDataStream& stream)
+    {
+      qint32 dpi;
+      stream >> dpi >> _font;
+      _dpi = dpi;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
@@ -375,6 +636,11 @@ namespace {
       painter.setFont(tempfont);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(FontType) << qint32(_dpi) << _font;
+    }
+
   private:
     int _dpi;
     QFont _font;
@@ -385,6 +651,10 @@ namespace {
     TransformElement(const QTransform& t)
       : _t(t)
     {}
+    TransformElement(QDataStream& stream)
+    {
+      stream >> _t;
+    }
 
     void paint(QPainter& painter, const QTransform& origtransform)
     {
@@ -392,6 +662,11 @@ namespace {
       painter.setWorldTransform(_t, true);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(TransformType) << _t;
+    }
+
   private:
     QTransform _t;
   };
@@ -401,12 +676,21 @@ namespace {
     ClipEnabledElement(bool enabled)
       : _enabled(enabled)
     {}
+    ClipEnabledElement(QDataStream& stream)
+    {
+      stream >> _enabled;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setClipping(_enabled);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(ClipEnabledType) << _enabled;
+    }
+
   private:
     bool _enabled;
   };
@@ -416,12 +700,21 @@ namespace {
     PenElement(const QPen& pen)
       : _pen(pen)
     {}
+    PenElement(QDataStream& stream)
+    {
+      stream >> _pen;
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setPen(_pen);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(PenType) << _pen;
+    }
+
   private:
     QPen _pen;
   };
@@ -431,12 +724,23 @@ namespace {
     HintsElement(QPainter::RenderHints hints)
       : _hints(hints)
     {}
+    HintsElement(QDataStream& stream)
+    {
+      qint32 hints;
+      stream >> hints;
+      _hints = QPainter::RenderHints(hints);
+    }
 
     void paint(QPainter& painter, const QTransform&)
     {
       painter.setRenderHints(_hints);
     }
 
+    void save(QDataStream& stream) const
+    {
+      stream << quint8(HintsType) << qint32(_hints);
+    }
+
   private:
     QPainter::RenderHints _hints;
   };
@@ -445,6 +749,76 @@ namespace {
   // end anonymous block
 }
 
+///////////////////////////////////////////////////////////////////
+// Serialization factory
+
+PaintElement* createPaintElement(QDataStream& stream, ElementArena& arena)
+{
+  quint8 type;
+  stream >> type;
+
+  switch( ElementType(type) )
+    {
+    case EllipseType:
+      return new (arena) EllipseElement(stream);
+    case EllipseFType:
+      return new (arena) EllipseFElement(stream);
+    case ImageType:
+      return new (arena) ImageElement(stream);
+    case LineType:
+      return new (arena) LineElement(stream);
+    case LineFType:
+      return new (arena) LineFElement(stream);
+    case PathType:
+      return new (arena) PathElement(stream);
+    case PixmapType:
+      return new (arena) PixmapElement(stream);
+    case PointType:
+      return new (arena) PointElement(stream);
+    case PointFType:
+      return new (arena) PointFElement(stream);
+    case PolygonType:
+      return new (arena) PolygonElement(stream);
+    case PolygonFType:
+      return new (arena) PolygonFElement(stream);
+    case RectType:
+      return new (arena) RectElement(stream);
+    case RectFType:
+      return new (arena) RectFElement(stream);
+    case TextType:
+      return new (arena) TextElement(stream);
+    case TiledPixmapType:
+      return new (arena) TiledPixmapElement(stream);
+    case BackgroundBrushType:
+      return new (arena) BackgroundBrushElement(stream);
+    case BackgroundModeType:
+      return new (arena) BackgroundModeElement(stream);
+    case BrushType:
+      return new (arena) BrushElement(stream);
+    case BrushOriginType:
+      return new (arena) BrushOriginElement(stream);
+    case ClipRegionType:
+      return new (arena) ClipRegionElement(stream);
+    case ClipPathType:
+      return new (arena) ClipPathElement(stream);
+    case CompositionType:
+      return new (arena) CompositionElement(stream);
+    case FontType:
+      return new (arena) FontElement(stream);
+    case TransformType:
+      return new (arena) TransformElement(stream);
+    case ClipEnabledType:
+      return new (arena) ClipEnabledElement(stream);
+    case PenType:
+      return new (arena) PenElement(stream);
+    case HintsType:
+      return new (arena) HintsElement(stream);
+    default:
+      // unknown element in stream
+      return 0;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////
 // Paint engine follows
 
@@ -464,18 +838,23 @@ bool RecordPaintEngine::begin(QPaintDevice* pdev)
   return 1;
 }
 
+ElementArena& RecordPaintEngine::arena()
+{
+  return _pdev->arena();
+}
+
 // for each type of drawing command we add a new element
 // to the list maintained by the device
 
 void RecordPaintEngine::drawEllipse(const QRectF& rect)
 {
-  _pdev->addElement( new EllipseFElement(rect) );
+  _pdev->addElement( new (arena()) EllipseFElement(rect) );
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawEllipse(const QRect& rect)
 {
-  _pdev->addElement( new EllipseElement(rect) );
+  _pdev->addElement( new (arena()) EllipseElement(rect) );
   _drawitemcount++;
 }
 
@@ -484,77 +863,77 @@ void RecordPaintEngine::drawImage(const QRectF& rectangle,
 				  const QRectF& sr,
 				  Qt::ImageConversionFlags flags)
 {
-  _pdev->addElement( new ImageElement(rectangle, image, sr, flags) );
+  _pdev->addElement( new (arena()) ImageElement(rectangle, image, sr, flags) );
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawLines(const QLineF* lines, int lineCount)
 {
-  _pdev->addElement( new LineFElement(lines, lineCount) );
+  _pdev->addElement( new (arena()) LineFElement(lines, lineCount) );
   _drawitemcount += lineCount;
 }
 
 void RecordPaintEngine::drawLines(const QLine* lines, int lineCount)
 {
-  _pdev->addElement( new LineElement(lines, lineCount) );
+  _pdev->addElement( new (arena()) LineElement(lines, lineCount) );
   _drawitemcount += lineCount;
 }
 
 void RecordPaintEngine::drawPath(const QPainterPath& path)
 {
-  _pdev->addElement( new PathElement(path) );
+  _pdev->addElement( new (arena()) PathElement(path) );
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawPixmap(const QRectF& r,
 				   const QPixmap& pm, const QRectF& sr)
 {
-  _pdev->addElement( new PixmapElement(r, pm, sr) );
+  _pdev->addElement( new (arena()) PixmapElement(r, pm, sr) );
   _drawitemcount++;
 }
 
 void RecordPaintEngine::drawPoints(const QPointF* points, int pointCount)
 {
-  _pdev->addElement( new PointFElement(points, pointCount) );
+  _pdev->addElement( new (arena()) PointFElement(points, pointCount) );
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawPoints(const QPoint* points, int pointCount)
 {
-  _pdev->addElement( new PointElement(points, pointCount) );
+  _pdev->addElement( new (arena()) PointElement(points, pointCount) );
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawPolygon(const QPointF* points, int pointCount,
 				    QPaintEngine::PolygonDrawMode mode)
 {
-  _pdev->addElement( new PolygonFElement(points, pointCount, mode) );
+  _pdev->addElement( new (arena()) PolygonFElement(points, pointCount, mode) );
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawPolygon(const QPoint* points, int pointCount,
 				    QPaintEngine::PolygonDrawMode mode)
 {
-  _pdev->addElement( new PolygonElement(points, pointCount, mode) );
+  _pdev->addElement( new (arena()) PolygonElement(points, pointCount, mode) );
   _drawitemcount += pointCount;
 }
 
 void RecordPaintEngine::drawRects(const QRectF* rects, int rectCount)
 {
-  _pdev->addElement( new RectFElement( rects, rectCount ) );
+  _pdev->addElement( new (arena()) RectFElement( rects, rectCount ) );
   _drawitemcount += rectCount;
 }
 
 void RecordPaintEngine::drawRects(const QRect* rects, int rectCount)
 {
-  _pdev->addElement( new RectElement( rects, rectCount ) );
+  _pdev->addElement( new (arena()) RectElement( rects, rectCount ) );
   _drawitemcount += rectCount;
 }
 
 void RecordPaintEngine::drawTextItem(const QPointF& p,
 				     const QTextItem& textItem)
 {
-  _pdev->addElement( new TextElement(p, textItem) );
+  _pdev->addElement( new (arena()) TextElement(p, textItem) );
   _drawitemcount += textItem.text().length();
 }
 
@@ -562,7 +941,7 @@ void RecordPaintEngine::drawTiledPixmap(const QRectF& rect,
 					      const QPixmap& pixmap,
 					      const QPointF& p)
 {
-  _pdev->addElement( new TiledPixmapElement(rect, pixmap, p) );
+  _pdev->addElement( new (arena()) TiledPixmapElement(rect, pixmap, p) );
   _drawitemcount += 1;
 }
 
@@ -584,29 +963,29 @@ void RecordPaintEngine::updateState(const QPaintEngineState& state)
   // these are replayed later
   const int flags = state.state();
   if( flags & QPaintEngine::DirtyBackground )
-    _pdev->addElement( new BackgroundBrushElement( state.backgroundBrush() ) );
+    _pdev->addElement( new (arena()) BackgroundBrushElement( state.backgroundBrush() ) );
   if( flags & QPaintEngine::DirtyBackgroundMode )
-    _pdev->addElement( new BackgroundModeElement( state.backgroundMode() ) );
+    _pdev->addElement( new (arena()) BackgroundModeElement( state.backgroundMode() ) );
   if( flags & QPaintEngine::DirtyBrush )
-    _pdev->addElement( new BrushElement( state.brush() ) );
+    _pdev->addElement( new (arena()) BrushElement( state.brush() ) );
   if( flags & QPaintEngine::DirtyBrushOrigin )
-    _pdev->addElement( new BrushOriginElement( state.brushOrigin() ) );
+    _pdev->addElement( new (arena()) BrushOriginElement( state.brushOrigin() ) );
   if( flags & QPaintEngine::DirtyClipRegion )
-    _pdev->addElement( new ClipRegionElement( state.clipOperation(),
-					      state.clipRegion() ) );
+    _pdev->addElement( new (arena()) ClipRegionElement( state.clipOperation(),
+						      state.clipRegion() ) );
   if( flags & QPaintEngine::DirtyClipPath )
-    _pdev->addElement( new ClipPathElement( state.clipOperation(),
-					    state.clipPath() ) );
+    _pdev->addElement( new (arena()) ClipPathElement( state.clipOperation(),
+						    state.clipPath() ) );
   if( flags & QPaintEngine::DirtyCompositionMode )
-    _pdev->addElement( new CompositionElement( state.compositionMode() ) );
+    _pdev->addElement( new (arena()) CompositionElement( state.compositionMode() ) );
   if( flags & QPaintEngine::DirtyFont )
-    _pdev->addElement( new FontElement( state.font(), _pdev->_dpiy ) );
+    _pdev->addElement( new (arena()) FontElement( state.font(), _pdev->_dpiy ) );
   if( flags & QPaintEngine::DirtyTransform )
-    _pdev->addElement( new TransformElement( state.transform() ) );
+    _pdev->addElement( new (arena()) TransformElement( state.transform() ) );
   if( flags & QPaintEngine::DirtyClipEnabled )
-    _pdev->addElement( new ClipEnabledElement( state.isClipEnabled() ) );
+    _pdev->addElement( new (arena()) ClipEnabledElement( state.isClipEnabled() ) );
   if( flags & QPaintEngine::DirtyPen )
-    _pdev->addElement( new PenElement( state.pen() ) );
+    _pdev->addElement( new (arena()) PenElement( state.pen() ) );
   if( flags & QPaintEngine::DirtyHints )
-    _pdev->addElement( new HintsElement( state.renderHints() ) );
+    _pdev->addElement( new (arena()) HintsElement( state.renderHints() ) );
 }
@@ -30,6 +30,7 @@
 #include <QRect>
 #include <QPixmap>
 
+class ElementArena;
 class RecordPaintDevice;
 
 class RecordPaintEngine : public QPaintEngine
@@ -67,6 +68,10 @@ public:
   // return an estimate of number of items drawn
   int drawItemCount() const { return _drawitemcount; }
 
+private:
+  // arena of the device which elements are recorded into
+  ElementArena& arena();
+
 private:
   int _drawitemcount;
   RecordPaintDevice* _pdev;
@@ -200,6 +200,9 @@ setup(name = 'veusz',
                    'helpers/src/qtloops/polylineclip.cpp',
                    'helpers/src/qtloops/beziers.cpp',
                    'helpers/src/qtloops/beziers_qtwrap.cpp',
+                   'helpers/src/qtloops/linesimplify.cpp',
+                   'helpers/src/qtloops/pointindex.cpp',
+                   'helpers/src/qtloops/instrument.cpp',
                    'helpers/src/qtloops/numpyfuncs.cpp',
                    'helpers/src/qtloops/qtloops.sip'],
                   language="c++",
@@ -0,0 +1,145 @@
+#!/usr/bin/env python
+
+#    Copyright (C) 2012 Jeremy S. Sanders
+#    Email: Jeremy Sanders <jeremy@jeremysanders.net>
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+##############################################################################
+
+"""Microbenchmarks for the veusz.helpers hot paths.
+
+Drives plotLinesToPainter, plotPathsToPainter, plotClippedPolyline,
+numpyToQImage, binData and polygonClip through the same bindings the
+plotting code uses, painting onto an offscreen QImage, and reports
+ns/point and MB/s for each. Run before and after helper changes to
+catch regressions:
+
+    runbenchmarks.py [--points N] [--repeats N] [--warmup N]
+
+This program requires the veusz module to be on the PYTHONPATH and the
+compiled helpers to be importable (it aborts rather than timing the
+slow python fallbacks).
+"""
+
+import optparse
+import sys
+import time
+
+import numpy as N
+import veusz.qtall as qt4
+
+try:
+    from veusz.helpers.qtloops import ( plotLinesToPainter,
+                                        plotPathsToPainter,
+                                        plotClippedPolyline,
+                                        polygonClip,
+                                        numpyToQImage,
+                                        binData )
+except ImportError:
+    print >>sys.stderr, ( "Compiled helpers not found: "
+                          "there is nothing useful to benchmark" )
+    sys.exit(1)
+
+def benchmark(name, func, numpoints, numbytes, repeats, warmup):
+    """Time func over repeats runs, printing ns/point and MB/s."""
+
+    for i in xrange(warmup):
+        func()
+
+    times = []
+    for i in xrange(repeats):
+        start = time.time()
+        func()
+        times.append(time.time() - start)
+
+    best = min(times)
+    nsppt = best * 1e9 / numpoints
+    mbps = numbytes / best / 1e6
+    print "%-24s %10.1f ns/point %10.1f MB/s (best of %i)" % (
+        name, nsppt, mbps, repeats)
+
+def main():
+    parser = optparse.OptionParser(usage="%prog [options]",
+                                   description=__doc__.split('\n')[0])
+    parser.add_option("--points", type="int", default=1000000,
+                      help="points per dataset (default %default)")
+    parser.add_option("--repeats", type="int", default=5,
+                      help="timed repetitions (default %default)")
+    parser.add_option("--warmup", type="int", default=1,
+                      help="untimed warmup runs (default %default)")
+    options, args = parser.parse_args()
+
+    npts = options.points
+    repeats = options.repeats
+    warmup = options.warmup
+
+    # offscreen paint device shared by the painting benchmarks
+    image = qt4.QImage(1024, 768, qt4.QImage.Format_ARGB32_Premultiplied)
+    clip = qt4.QRectF(0, 0, 1024, 768)
+
+    # synthetic datasets: a noisy walk crossing the clip rectangle
+    N.random.seed(42)
+    x = N.random.uniform(-200., 1200., npts)
+    y = N.cumsum(N.random.uniform(-5., 5., npts)) % 900. - 50.
+    x2 = x + N.random.uniform(0., 10., npts)
+    y2 = y + N.random.uniform(0., 10., npts)
+
+    painter = qt4.QPainter(image)
+
+    def bench_lines():
+        plotLinesToPainter(painter, x, y, x2, y2, clip)
+    benchmark("plotLinesToPainter", bench_lines, npts, npts*4*8,
+              repeats, warmup)
+
+    path = qt4.QPainterPath()
+    path.addEllipse(qt4.QRectF(-2, -2, 4, 4))
+    def bench_paths():
+        plotPathsToPainter(painter, path, x, y, None, clip)
+    benchmark("plotPathsToPainter", bench_paths, npts, npts*2*8,
+              repeats, warmup)
+
+    poly = qt4.QPolygonF()
+    for i in xrange(0, npts, max(1, npts//200000)):
+        poly.append(qt4.QPointF(x[i], y[i]))
+    numpoly = len(poly)
+    def bench_polyline():
+        plotClippedPolyline(painter, clip, poly)
+    benchmark("plotClippedPolyline", bench_polyline, numpoly,
+              numpoly*2*8, repeats, warmup)
+
+    def bench_polygonclip():
+        out = qt4.QPolygonF()
+        polygonClip(poly, clip, out)
+    benchmark("polygonClip", bench_polygonclip, numpoly,
+              numpoly*2*8, repeats, warmup)
+
+    painter.end()
+
+    # image conversion on a square array of about the requested size
+    side = max(2, int(N.sqrt(npts)))
+    img = N.random.uniform(0., 1., (side, side))
+    cmap = N.array([(0, 0, 0, 255), (255, 255, 255, 255)], dtype=N.intc)
+    def bench_image():
+        numpyToQImage(img, cmap, False)
+    benchmark("numpyToQImage", bench_image, side*side, side*side*8,
+              repeats, warmup)
+
+    def bench_bindata():
+        binData(y, 10, True)
+    benchmark("binData", bench_bindata, npts, npts*8,
+              repeats, warmup)
+
+if __name__ == '__main__':
+    main()
@@ -21,7 +21,7 @@ import numpy as N
 # use fast or slow helpers
 slowfuncs = False
 try:
-    from veusz.helpers.qtloops import numpyToQImage, applyImageTransparancy
+    from veusz.helpers.qtloops import numpyToQImage
 except ImportError:
     slowfuncs = True
     from slowfuncs import slowNumpyToQImage
@@ -183,9 +183,8 @@ def applyColorMap(cmap, scaling, datain, minval, maxval,
     fracs = applyScaling(datain, scaling, minval, maxval)
 
     if not slowfuncs:
-        img = numpyToQImage(fracs, cmap, transimg is not None)
-        if transimg is not None:
-            applyImageTransparancy(img, transimg)
+        # transparency image is applied while converting
+        img = numpyToQImage(fracs, cmap, False, transimg)
     else:
         img = slowNumpyToQImage(fracs, cmap, transimg)
     return img
@@ -22,9 +22,10 @@ import veusz.qtall as qt4
 import numpy as N
 
 try:
-    from veusz.helpers.qtloops import plotPathsToPainter
+    from veusz.helpers.qtloops import plotPathsToPainter, PointIndex
 except ImportError:
     from slowfuncs import plotPathsToPainter
+    PointIndex = None
 
 import colormap
 
@@ -400,7 +401,7 @@ MarkerCodes = (
     )
 
 def plotMarkers(painter, xpos, ypos, markername, markersize, scaling=None,
-                clip=None, cmap=None, colorvals=None):
+                clip=None, cmap=None, colorvals=None, pointindex=None):
     """Funtion to plot an array of markers on a painter.
 
     painter: QPainter
@@ -411,6 +412,8 @@ def plotMarkers(painter, xpos, ypos, markername, markersize, scaling=None,
     clip: rectangle if clipping wanted
     cmap: colormap to use if colorvals is set
     colorvals: color values 0-1 of each point if used
+    pointindex: optional PointIndex built over xpos and ypos, reused
+      between redraws to only examine points near the clip rectangle
     """
 
     # minor optimization
@@ -440,7 +443,8 @@ def plotMarkers(painter, xpos, ypos, markername, markersize, scaling=None,
             cmap, 'linear', color2d, 0., 1., trans)
 
     # this is the fast (C++) or slow (python) helper
-    plotPathsToPainter(painter, path, xpos, ypos, scaling, clip, colorimg)
+    plotPathsToPainter(painter, path, xpos, ypos, scaling, clip, colorimg,
+                       pointindex)
 
     painter.restore()
 
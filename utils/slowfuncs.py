@@ -77,8 +77,11 @@ def addNumpyPolygonToPath(path, clip, *args):
             path.closeSubpath()
 
 def plotPathsToPainter(painter, path, x, y, scaling=None,
-                       clip=None, colorimg=None):
-    """Plot array of x, y points."""
+                       clip=None, colorimg=None, pointindex=None):
+    """Plot array of x, y points.
+
+    pointindex is accepted for compatibility with the fast helper and
+    ignored here."""
 
     if clip is None:
         clip = qt4.QRectF(qt4.QPointF(-32767,-32767),qt4.QPointF(32767,32767))
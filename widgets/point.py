@@ -499,7 +499,11 @@ class PointPlotter(GenericPlotter):
     def _getBezierLine(self, poly):
         """Try to draw a bezier line connecting the points."""
 
-        npts = qtloops.bezier_fit_cubic_multi(poly, 0.1, len(poly)+1)
+        if len(poly) > 1000:
+            # fit long polylines in chunks to avoid deep recursion
+            npts = qtloops.bezier_fit_cubic_chunked(poly, 0.1)
+        else:
+            npts = qtloops.bezier_fit_cubic_multi(poly, 0.1, len(poly)+1)
         i = 0
         path = qt4.QPainterPath()
         lastpt = qt4.QPointF(-999999,-999999)